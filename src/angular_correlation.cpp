@@ -0,0 +1,100 @@
+#ifndef ANGULAR_CORRELATION_CPP_
+#define ANGULAR_CORRELATION_CPP_
+# define PI           3.14159265358979323846
+#include <algorithm>
+#include <math.h>
+
+#include "angular_correlation.h"
+
+AngularCorrelation::AngularCorrelation(const ImgConverter::ROI &roi, const Vec2 &hub, double scale, const std::vector<ImgConverter::ROI> &excluded,
+    size_t numAngles, size_t numRadii) :
+    _fft(numAngles)
+{
+    const size_t nAngles = _fft.size();
+    // radii from close to the hub up to the farthest corner of the region of interest (in pixels)
+    const double hubRow = hub[0] * scale;
+    const double hubCol = hub[1] * scale;
+    double maxRadius = 0.0;
+    for (double row : {static_cast<double>(roi.minRow), static_cast<double>(roi.maxRow)}) {
+        for (double col : {static_cast<double>(roi.minCol), static_cast<double>(roi.maxCol)}) {
+            maxRadius = std::max(maxRadius, std::hypot(row - hubRow, col - hubCol));
+        }
+    }
+    const double minRadius = 2.0;
+
+    // sample all blade periods and sort the samples by their folded angle bin
+    _sampleBegin.assign(nAngles + 1, 0);
+    for (size_t bin = 0; bin < nAngles; ++bin) {
+        _sampleBegin[bin] = _samplePixels.size();
+        for (size_t blade = 0; blade < numBlades; ++blade) {
+            double phi = 2.0 * PI * (blade * nAngles + bin + 0.5) / (numBlades * nAngles);
+            for (size_t iRadius = 0; iRadius < numRadii; ++iRadius) {
+                double radius = minRadius + (iRadius + 0.5) * (maxRadius - minRadius) / numRadii;
+                long row = std::lround(hubRow + radius * std::cos(phi));
+                long col = std::lround(hubCol + radius * std::sin(phi));
+                if (row < static_cast<long>(roi.minRow) || row >= static_cast<long>(roi.maxRow) ||
+                    col < static_cast<long>(roi.minCol) || col >= static_cast<long>(roi.maxCol))
+                    continue;
+                bool isExcluded = false;
+                for (auto &region : excluded) {
+                    isExcluded = isExcluded || (static_cast<size_t>(row) >= region.minRow && static_cast<size_t>(row) < region.maxRow &&
+                        static_cast<size_t>(col) >= region.minCol && static_cast<size_t>(col) < region.maxCol);
+                }
+                if (!isExcluded)
+                    _samplePixels.push_back(static_cast<uint32_t>(row) << 16 | static_cast<uint32_t>(col));
+            }
+        }
+    }
+    _sampleBegin[nAngles] = _samplePixels.size();
+}
+
+void AngularCorrelation::getSpectrum(const ImgConverter &img, const std::vector<uint8_t> &rgbThreshold, double varianceThreshold, Spectrum &spectrum) const
+{
+    const size_t nAngles = _fft.size();
+    // folded angular profile without its mean
+    spectrum.resize(nAngles);
+    double mean = 0.0;
+    for (size_t bin = 0; bin < nAngles; ++bin) {
+        size_t count = 0;
+        for (size_t i = _sampleBegin[bin]; i < _sampleBegin[bin + 1]; ++i) {
+            count += img.isAboveThreshold(_samplePixels[i] >> 16, _samplePixels[i] & 0xffff, rgbThreshold, varianceThreshold) ? 1 : 0;
+        }
+        spectrum[bin] = static_cast<double>(count);
+        mean += count;
+    }
+    mean /= nAngles;
+    for (auto &value : spectrum) {
+        value -= mean;
+    }
+    _fft.transform(spectrum);
+}
+
+double AngularCorrelation::getRotation(const Spectrum &spectrumPrev, const Spectrum &spectrumCur) const
+{
+    const size_t nAngles = _fft.size();
+    if (spectrumPrev.size() != nAngles || spectrumCur.size() != nAngles)
+        return NAN;
+    // cross power spectrum (reused by all calls of this thread)
+    thread_local Spectrum correlation;
+    correlation.resize(nAngles);
+    for (size_t k = 0; k < nAngles; ++k) {
+        correlation[k] = spectrumCur[k] * std::conj(spectrumPrev[k]);
+    }
+    _fft.transform(correlation, true);
+
+    // peak of the correlation with sub-bin accuracy (parabola through the peak bin and its neighbours)
+    size_t peak = 0;
+    for (size_t k = 1; k < nAngles; ++k) {
+        if (correlation[k].real() > correlation[peak].real())
+            peak = k;
+    }
+    double left = correlation[(peak + nAngles - 1) % nAngles].real();
+    double center = correlation[peak].real();
+    double right = correlation[(peak + 1) % nAngles].real();
+    double curvature = left - 2.0 * center + right;
+    double shift = peak + ((curvature < 0.0) ? 0.5 * (left - right) / curvature : 0.0);
+    shift -= nAngles * std::round(shift / nAngles);
+    return shift * 2.0 * PI / (numBlades * nAngles);
+}
+
+#endif /* ANGULAR_CORRELATION_CPP_ */
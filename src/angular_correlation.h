@@ -0,0 +1,49 @@
+#ifndef ANGULAR_CORRELATION_H_
+#define ANGULAR_CORRELATION_H_
+
+#include <stdint.h>
+#include <complex>
+#include <vector>
+
+#include "clustering.h"
+#include "fft.h"
+#include "img_converter.h"
+
+// Measures the rotation of the rotor between two frames without clustering: the foreground mask of each
+// frame is resampled on a polar grid around the hub and summed over the radii to an angular profile, which
+// is folded onto a single blade period (2 pi / numBlades). The rotation is the shift of the peak of the
+// circular cross correlation of two profiles (inverse FFT of their cross power spectrum). Normalizing the
+// cross power spectrum (phase correlation) sharpens the peak too much for sub-bin interpolation of these short profiles.
+// The pixel of every polar sample is precomputed for the region of interest and the threshold test of the
+// point extraction is evaluated at these pixels of the decoded image only, thus the cost per frame is
+// O(polar samples + FFT), independent of the number of foreground pixels.
+class AngularCorrelation
+{
+public:
+    // number of blades of the rotor
+    static constexpr std::size_t numBlades = 3;
+    // spectrum of the angular profile of a frame
+    typedef std::vector<std::complex<double>> Spectrum;
+
+    // Constructor: precomputes the polar sampling of the region of interest around the hub (hub in scaled
+    // coordinates as the points, numAngles per blade period is rounded up to a power of two), pixels in the
+    // excluded regions are not sampled
+    AngularCorrelation(const ImgConverter::ROI &roi, const Vec2 &hub, double scale, const std::vector<ImgConverter::ROI> &excluded = {},
+        std::size_t numAngles = 256, std::size_t numRadii = 64);
+
+    // computes the spectrum of the folded angular profile of the foreground pixels of a decoded image
+    // (pixels passing the threshold test of the point extraction)
+    void getSpectrum(const ImgConverter &img, const std::vector<uint8_t> &rgbThreshold, double varianceThreshold, Spectrum &spectrum) const;
+    // returns the rotation in rad from the frame of spectrumPrev to the frame of spectrumCur
+    // (defined modulo 2 pi / numBlades, returned in [-pi / numBlades, pi / numBlades))
+    double getRotation(const Spectrum &spectrumPrev, const Spectrum &spectrumCur) const;
+
+private:
+    FFT _fft;
+    // pixels (row in the upper, column in the lower half) sampled for each folded angle bin,
+    // the samples of bin a are _samplePixels[_sampleBegin[a]] ... _samplePixels[_sampleBegin[a + 1] - 1]
+    std::vector<std::size_t> _sampleBegin;
+    std::vector<uint32_t> _samplePixels;
+};
+
+#endif // ANGULAR_CORRELATION_H_
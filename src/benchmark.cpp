@@ -0,0 +1,197 @@
+#include <stdint.h>
+#include <vector>
+#include <iostream>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <string>
+
+// file search
+#include <glob.h>
+
+// time measurement
+#include <chrono>
+
+#include "clustering.h"
+#include "kmeans_clustering.h"
+#include "mean_shift.h"
+#include "connected_components.h"
+#include "rotor_model.h"
+#include "polar_histogram.h"
+#include "img_converter.h"
+#include "parallel_image_processor.h"
+
+# define PI0_5           1.570796327
+
+// Compares throughput and angle accuracy of the clustering engines on the extracted points of all
+// input images. The Gaussian mixture model serves as reference for the cluster angles.
+
+// a clustering engine under test: fits the seeded clusters to the points of one frame
+struct BenchmarkEngine
+{
+    std::string name;
+    std::function<FitReport(std::vector<Vec2>, ClusterList &)> fit;
+};
+
+int main() {
+    // PARAMETERS (same as in main.cpp)
+    // ======================================
+    std::string pattern = "../img/*.png";
+    ImgConverter::ROI roi;
+    roi.maxCol = 500;
+    roi.maxRow = 500;
+    roi.minCol = 0;
+    roi.minRow = 0;
+    std::vector<uint8_t> rgbThreshold {80,250,255};
+    double varianceThreshold{1500.0};
+    double scale = 50;
+    FitOptions fitOptions;
+    // number of repetitions of the fitting for the time measurement
+    size_t repetitions = 5;
+
+    // COLLECTING IMAGE FILES AND EXTRACTING POINTS
+    // ======================================
+    glob_t glob_result;
+    glob(pattern.c_str(),GLOB_TILDE,NULL,&glob_result);
+    std::vector<std::string> files;
+    for(unsigned int i=0;i<glob_result.gl_pathc;++i){
+        files.push_back(std::string(glob_result.gl_pathv[i]));
+    }
+    globfree(&glob_result);
+    std::sort(files.begin(),files.end());
+
+    std::vector<std::vector<Vec2>> framePoints(files.size());
+    for (size_t i = 0; i < files.size(); ++i) {
+        ParallelImageProcessor<size_t>::extractPoints(files[i], roi, rgbThreshold, varianceThreshold, scale, framePoints[i]);
+    }
+    std::cout << "Benchmarking clustering engines on " << files.size() << " frames..." << std::endl;
+
+    // ENGINES UNDER TEST
+    // ======================================
+    std::vector<BenchmarkEngine> engines;
+    engines.push_back({"Gaussian mixture (EM)", [&fitOptions](std::vector<Vec2> points, ClusterList &clusters) {
+        std::vector<uint8_t> labels;
+        return fitClusterModel(points, clusters, labels, fitOptions);
+    }});
+    engines.push_back({"Gaussian mixture (EM, truncated)", [&fitOptions](std::vector<Vec2> points, ClusterList &clusters) {
+        FitOptions truncatedOptions = fitOptions;
+        truncatedOptions.truncationDistance = 5.0;
+        std::vector<uint8_t> labels;
+        return fitClusterModel(points, clusters, labels, truncatedOptions);
+    }});
+    engines.push_back({"Gaussian mixture (EM, coarse-to-fine)", [&fitOptions](std::vector<Vec2> points, ClusterList &clusters) {
+        FitOptions pyramidOptions = fitOptions;
+        pyramidOptions.pyramidLevels = 3;
+        std::vector<uint8_t> labels;
+        return fitClusterModel(points, clusters, labels, pyramidOptions);
+    }});
+    engines.push_back({"Gaussian mixture (EM, 3 speculative restarts)", [&fitOptions](std::vector<Vec2> points, ClusterList &clusters) {
+        FitOptions restartOptions = fitOptions;
+        restartOptions.restarts = 3;
+        std::vector<uint8_t> labels;
+        return fitClusterModelSpeculative(points, clusters, labels, restartOptions);
+    }});
+    engines.push_back({"Rotor model (constrained EM)", [&fitOptions](std::vector<Vec2> points, ClusterList &clusters) {
+        RotorModel rm(std::move(points));
+        FitReport report = rm.runClusterFitting(fitOptions);
+        rm.getClusters(clusters);
+        return report;
+    }});
+    engines.push_back({"Connected components (EM fallback)", [&fitOptions, scale](std::vector<Vec2> points, ClusterList &clusters) {
+        ConnectedComponents cc(points, scale);
+        if (cc.run()) {
+            cc.getClusters(clusters);
+            FitReport report;
+            report.converged = true;
+            return report;
+        }
+        std::vector<uint8_t> labels;
+        return fitClusterModel(points, clusters, labels, fitOptions);
+    }});
+    engines.push_back({"Mean shift (spatial hash)", [](std::vector<Vec2> points, ClusterList &clusters) {
+        MeanShiftModel ms(std::move(points));
+        FitReport report = ms.runClusterFitting();
+        ms.getClusters(clusters);
+        return report;
+    }});
+    // hub of the polar histogram located once on the first frame
+    RotorModel hubModel(framePoints.empty() ? std::vector<Vec2>() : framePoints.front());
+    hubModel.runClusterFitting(fitOptions);
+    PolarHistogram polarHistogram(roi, hubModel.hub, scale);
+    engines.push_back({"Polar histogram (no EM)", [&polarHistogram](std::vector<Vec2> points, ClusterList &clusters) {
+        FrameResult result;
+        FitReport report = polarHistogram.estimate(points, result);
+        clusters = result.clusters;
+        return report;
+    }});
+    engines.push_back({"k-means (Hamerly)", [&fitOptions](std::vector<Vec2> points, ClusterList &clusters) {
+        KMeansModel km(std::move(points), clusters);
+        FitReport report = km.runClusterFitting(fitOptions);
+        clusters = km.clusters;
+        return report;
+    }});
+
+    // RUN BENCHMARK
+    // ======================================
+    // fitted clusters of the reference engine per frame
+    std::vector<ClusterList> reference(files.size());
+    for (size_t iEngine = 0; iEngine < engines.size(); ++iEngine) {
+        auto &engine = engines[iEngine];
+        std::vector<ClusterList> results(files.size());
+        size_t totalIterations = 0;
+        size_t totalClusters = 0;
+        std::vector<size_t> totalLevelIterations;
+        double seconds = 0.0;
+        for (size_t rep = 0; rep < repetitions; ++rep) {
+            for (size_t i = 0; i < files.size(); ++i) {
+                ClusterList clusters;
+                ParallelImageProcessor<size_t>::initClusters(framePoints[i], clusters);
+                auto startTime = std::chrono::steady_clock::now();
+                FitReport report = engine.fit(framePoints[i], clusters);
+                seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+                totalIterations += report.iterations;
+                totalClusters += clusters.size();
+                totalLevelIterations.resize(std::max(totalLevelIterations.size(), report.levelIterations.size()), 0);
+                for (size_t level = 0; level < report.levelIterations.size(); ++level) {
+                    totalLevelIterations[level] += report.levelIterations[level];
+                }
+                results[i] = clusters;
+            }
+        }
+        if (iEngine == 0) {
+            reference = results;
+        }
+
+        // angle deviation of matched clusters wrt. reference (angles are defined modulo pi/2)
+        double sumAngleDiff = 0.0;
+        double maxAngleDiff = 0.0;
+        size_t nMatches = 0;
+        for (size_t i = 0; i < files.size(); ++i) {
+            size_t match[maxClusters];
+            Cluster::assignClusters(reference[i], results[i], match);
+            for (size_t k = 0; k < reference[i].size(); ++k) {
+                if (match[k] == Cluster::noMatch)
+                    continue;
+                double diff = results[i][match[k]].getAngle() - reference[i][k].getAngle();
+                diff = std::fabs(diff - PI0_5 * std::round(diff / PI0_5));
+                sumAngleDiff += diff;
+                maxAngleDiff = std::max(maxAngleDiff, diff);
+                ++nMatches;
+            }
+        }
+
+        std::cout << engine.name << ":" << std::endl;
+        std::cout << "  throughput:      " << repetitions * files.size() / seconds << " frames/s" << std::endl;
+        std::cout << "  iterations:      " << static_cast<double>(totalIterations) / (repetitions * files.size()) << " per frame" << std::endl;
+        std::cout << "  clusters:        " << static_cast<double>(totalClusters) / (repetitions * files.size()) << " per frame" << std::endl;
+        for (size_t level = 0; level < totalLevelIterations.size(); ++level) {
+            std::cout << "  level " << level << ":         " << static_cast<double>(totalLevelIterations[level]) / (repetitions * files.size())
+                      << " iterations per frame" << std::endl;
+        }
+        std::cout << "  angle deviation: " << sumAngleDiff / std::max<size_t>(nMatches, 1) << " rad mean, "
+                  << maxAngleDiff << " rad max" << std::endl;
+    }
+
+    return 0;
+}
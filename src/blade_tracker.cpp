@@ -0,0 +1,74 @@
+#ifndef BLADE_TRACKER_CPP_
+#define BLADE_TRACKER_CPP_
+#include <math.h>
+
+#include "blade_tracker.h"
+
+BladeTracker::BladeTracker(size_t maxTracks) :
+    _maxTracks(maxTracks), _active(maxTracks, false), _continued(maxTracks, false), _centers(maxTracks),
+    _angles(maxTracks, 0.0), _prevAngles(maxTracks, 0.0) {}
+
+void BladeTracker::update(const ClusterList &clusters, std::vector<size_t> &trackIds, double rotation)
+{
+    // match the clusters to the active tracks (rotated to the predicted position)
+    _activeIds.clear();
+    _activeCenters.clear();
+    Vec2 hub = Vec2::zero();
+    for (size_t id = 0; id < _maxTracks; ++id) {
+        if (_active[id]) {
+            _activeIds.push_back(id);
+            _activeCenters.push_back(_centers[id]);
+            hub += _centers[id];
+        }
+    }
+    if (rotation != 0.0 && !_activeCenters.empty()) {
+        hub = hub * (1.0 / _activeCenters.size());
+        Mat2 rot{{{std::cos(rotation), -std::sin(rotation)}, {std::sin(rotation), std::cos(rotation)}}};
+        for (auto &center : _activeCenters) {
+            center = hub + rot * (center - hub);
+        }
+    }
+    _clusterCenters.clear();
+    for (auto &cluster : clusters) {
+        _clusterCenters.push_back(cluster.center);
+    }
+    _match.resize(clusters.size());
+    Cluster::assignCenters(_clusterCenters, _activeCenters, _match.data());
+
+    // continue the matched tracks, tracks without cluster in this frame are closed
+    trackIds.assign(clusters.size(), noTrack);
+    std::fill(_active.begin(), _active.end(), false);
+    std::fill(_continued.begin(), _continued.end(), false);
+    for (size_t i = 0; i < clusters.size(); ++i) {
+        if (_match[i] != Cluster::noMatch) {
+            size_t id = _activeIds[_match[i]];
+            trackIds[i] = id;
+            _active[id] = true;
+            _continued[id] = true;
+        }
+    }
+    // start tracks for the unmatched clusters on the free IDs
+    size_t freeId = 0;
+    for (size_t i = 0; i < clusters.size(); ++i) {
+        if (trackIds[i] != noTrack)
+            continue;
+        while (freeId < _maxTracks && _active[freeId]) {
+            ++freeId;
+        }
+        if (freeId == _maxTracks)
+            break;
+        trackIds[i] = freeId;
+        _active[freeId] = true;
+    }
+
+    for (size_t i = 0; i < clusters.size(); ++i) {
+        size_t id = trackIds[i];
+        if (id == noTrack)
+            continue;
+        _prevAngles[id] = _angles[id];
+        _angles[id] = clusters[i].getAngle();
+        _centers[id] = clusters[i].center;
+    }
+}
+
+#endif /* BLADE_TRACKER_CPP_ */
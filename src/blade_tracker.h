@@ -0,0 +1,51 @@
+#ifndef BLADE_TRACKER_H_
+#define BLADE_TRACKER_H_
+
+#include <vector>
+
+#include "clustering.h"
+
+// Carries the identity of the rotor blades across frames: each blade cluster gets a small integer track ID
+// when it first appears, and the clusters of the next frame inherit the IDs of the clusters of the previous
+// frame they are matched to (minimum distance assignment of the cluster centers). Center and angle of every
+// track are kept in flat arrays indexed by the track ID, such that colors, per blade results and the angle
+// change between two frames are simple array lookups.
+class BladeTracker
+{
+public:
+    // ID of clusters without a track (more clusters than tracks)
+    static constexpr std::size_t noTrack = static_cast<std::size_t>(-1);
+
+    // Constructor
+    BladeTracker(std::size_t maxTracks = 3);
+
+    // assigns the track IDs to the clusters of the next frame (trackIds[i] is the ID of clusters[i]). Clusters
+    // matched to a track of the previous frame continue it, the others start a free track (if any).
+    // The tracks are rotated by the predicted rotation (rad) about their hub before matching
+    void update(const ClusterList &clusters, std::vector<std::size_t> &trackIds, double rotation = 0.0);
+    // returns true if the track has a cluster in the latest frame
+    bool isActive(std::size_t id) const { return id < _maxTracks && _active[id]; }
+    // returns true if the track was continued from the previous frame in the latest update
+    bool isContinued(std::size_t id) const { return id < _maxTracks && _continued[id]; }
+    // returns the cluster angle of the track in the previous and in the latest frame (see Cluster::getAngle)
+    double getPreviousAngle(std::size_t id) const { return _prevAngles[id]; }
+    double getAngle(std::size_t id) const { return _angles[id]; }
+    // returns the maximum number of tracks
+    std::size_t getMaxTracks() const { return _maxTracks; }
+
+private:
+    std::size_t _maxTracks;
+    // state per track ID
+    std::vector<bool> _active;
+    std::vector<bool> _continued;
+    std::vector<Vec2> _centers;
+    std::vector<double> _angles;
+    std::vector<double> _prevAngles;
+    // buffers of the matching (reused between frames)
+    std::vector<std::size_t> _activeIds;
+    std::vector<Vec2> _activeCenters;
+    std::vector<Vec2> _clusterCenters;
+    std::vector<std::size_t> _match;
+};
+
+#endif // BLADE_TRACKER_H_
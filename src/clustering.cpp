@@ -2,6 +2,7 @@
 #define CLUSTERING_CPP_
 # define PI           3.14159265358979323846
 #include <algorithm>
+#include <cassert>
 #include <math.h>
 #include <string>
 #include <memory>
@@ -9,220 +10,705 @@
 #include <iostream>
 #include <numeric>
 #include <map>
+#include <future>
+#include <mutex>
 
 #include "clustering.h"
 #include "utility.h"
 
-Cluster::Cluster(std::vector<double> centerIn, std::vector<std::vector<double>> sigmaIn,double weightingIn) {
+Cluster::Cluster() : center(Vec2::zero()), sigma(Mat2::identity()), weighting(0.0) {}
+
+Cluster::Cluster(Vec2 centerIn, Mat2 sigmaIn, double weightingIn) {
     center = centerIn;
     sigma = sigmaIn;
     weighting = weightingIn;
-    cPoints = std::make_shared<std::vector<std::vector<double>>>();
 }
 // return the angle in rad of the (major) principal axis ratio and x direction (pos about z)
-double Cluster::getAngle() {
+double Cluster::getAngle() const {
     return 0.5 * std::atan(2.0 * sigma[0][1] / (sigma[0][0] - sigma[1][1]));
 }
 
 // return the signal to noise ratio of this cluster
-double Cluster::getSNR() {
-    double a = sigma[0][0];
-    double b = sigma[1][1];
-    double c = sigma[0][1];
-    double d = std::sqrt(std::pow(a - b, 2.0) + 4.0 * std::pow(c, 2.0));
-    double eig1  = 0.5 * (a + b + d);
-    double eig2  = 0.5 * (a + b - d);
-    return eig2 / eig1;
-}
-
-void Cluster::expectation(std::vector<std::vector<double>> points, std::vector<double>&probabilities) {
-    std::vector<std::vector<double>> sigmaChol{{0,0},{0,0}};
-    // Cholesky decomposition of sigma matrix
-    Utility::choleskyDecomposition(sigma, sigmaChol);
-
-    std::vector<double> pnt1{0,0};
-    std::vector<double> pnt2{0,0};
-    
-    // normalization constant
-    double c1 = 2 * log(2 * PI) + 2 * log(sigmaChol[0][0]) + log(sigmaChol[1][1]);
-    // nomalize points:    
-    for (size_t i = 0; i < points.size(); ++i)
+double Cluster::getSNR() const {
+    Vec2 eigVals;
+    Mat2 eigVecs;
+    sigma.symmetricEigen(eigVals, eigVecs);
+    return eigVals[1] / eigVals[0];
+}
+
+double Cluster::getClusterDistance(const Cluster &cluster) const {
+    return (center - cluster.center).norm();
+}
+
+namespace {
+
+// array of n elements on the stack for n <= N, on the heap otherwise
+template <class T, std::size_t N>
+class SmallBuffer
+{
+public:
+    SmallBuffer(std::size_t n, T value = T())
     {
-        pnt1 = {points[i][0] - center[0], points[i][1] - center[1]};
-        Utility::backwardSubstitution(sigmaChol, pnt1, pnt2);
-        probabilities[i] = -(c1 + pnt2[0] * pnt2[0] + pnt2[1] * pnt2[1]) / 2.0 + log(weighting);
-    }
-}
-
-void Cluster::maximize(std::vector<std::vector<double>> points, std::vector<double> prob) {
-    double sumProb = std::accumulate(prob.begin(), prob.end(), 0.0);
-
-    // calculate new weight
-    weighting = sumProb / points.size();
-
-    // calculate new center values
-    // 1/sumProbabilities * sum(points * probabilities)
-    double c1 =  1.0 / sumProb * 
-        std::inner_product(points.begin(), points.end(), prob.begin(), 0.0, std::plus<>(),
-        [](auto pnt, auto p) {return pnt[0]*p;});
-    double c2 = 1.0 / sumProb * 
-        std::inner_product(points.begin(), points.end(), prob.begin(), 0.0, std::plus<>(),
-        [](auto pnt, auto p) {return pnt[1]*p;});   
-    center = {c1, c2};
- 
-    // calculate new covariance matrix
-    sigma[0][0] = 1.0 / (sumProb + 1.0e-6) * 
-        std::inner_product(points.begin(), points.end(), prob.begin(), 0.0, std::plus<>(),
-        [c1](auto pnt, auto p) {double pnt1 = (pnt[0] - c1) * sqrt(p);
-            return pnt1*pnt1; });
-    sigma[0][1] = 1.0 / (sumProb) * 
-        std::inner_product(points.begin(), points.end(), prob.begin(), 0.0, std::plus<>(),
-        [c1,c2](auto pnt, auto p) {double pnt1 = (pnt[0] - c1) * sqrt(p);double pnt2 = (pnt[1] - c2) * sqrt(p);
-            return pnt1*pnt2; });
-    sigma[1][0] = sigma[0][1];
-    sigma[1][1] = 1.0 / (sumProb + 1.0e-6) * 
-        std::inner_product(points.begin(), points.end(), prob.begin(), 0.0, std::plus<>(),
-        [c2](auto pnt, auto p) {double pnt2 = (pnt[1] - c2) * sqrt(p);
-            return pnt2*pnt2; });
-}
-
-double Cluster::getClusterDistance(std::shared_ptr<Cluster> &cluster) {
-    double x0 = center[0];
-    double y0 = center[1];
-    double x1 = cluster->center[0];
-    double y1 = cluster->center[1];
-    return std::sqrt(std::pow(x0-x1,2)+std::pow(y0-y1,2));
-}
-
-void Cluster::matchClusters(const std::vector<std::shared_ptr<Cluster>>&clist1,
-    const std::vector<std::shared_ptr<Cluster>>&clist2,
-    std::map<std::shared_ptr<Cluster>,std::shared_ptr<Cluster>> &cmap){
-        std::vector<std::pair<std::shared_ptr<Cluster>,std::shared_ptr<Cluster>>> tuples;
-        // generate all possible tuples of clusters
-        for(auto &cluster1:clist1) {
-            for(auto &cluster2:clist2) {
-                tuples.push_back(std::make_pair(cluster1, cluster2));
+        if (n > N) {
+            _heap.assign(n, value);
+            _data = _heap.data();
+        } else {
+            std::fill(_stack, _stack + n, value);
+            _data = _stack;
+        }
+    }
+    SmallBuffer(const SmallBuffer &) = delete;
+    SmallBuffer &operator=(const SmallBuffer &) = delete;
+    T &operator[](std::size_t i) { return _data[i]; }
+    const T &operator[](std::size_t i) const { return _data[i]; }
+
+private:
+    T _stack[N];
+    std::vector<T> _heap;
+    T *_data;
+};
+
+// largest matrix solved by trying all permutations
+const std::size_t maxBruteForceSize = 4;
+
+// exact minimum cost assignment of the rows to the columns of the n x n cost matrix (row major):
+// all permutations for small n and the Hungarian algorithm (shortest augmenting paths with potentials) otherwise
+template <class Matrix>
+void solveAssignment(const Matrix &cost, std::size_t n, std::size_t *rowToCol)
+{
+    if (n <= maxBruteForceSize) {
+        std::size_t perm[maxBruteForceSize];
+        std::iota(perm, perm + n, 0);
+        double minCost = INFINITY;
+        do {
+            double sum = 0.0;
+            for (std::size_t i = 0; i < n; ++i) {
+                sum += cost[i * n + perm[i]];
             }
+            if (sum < minCost) {
+                minCost = sum;
+                std::copy(perm, perm + n, rowToCol);
+            }
+        } while (std::next_permutation(perm, perm + n));
+        return;
+    }
+
+    // potentials of rows and columns, row assigned to each column and previous column on the augmenting path
+    // (index 0 is a virtual column, rows and columns are counted from 1)
+    const std::size_t N = Cluster::maxStackClusters + 1;
+    SmallBuffer<double, N> u(n + 1, 0.0), v(n + 1, 0.0), minv(n + 1);
+    SmallBuffer<std::size_t, N> p(n + 1, 0), way(n + 1, 0);
+    SmallBuffer<char, N> used(n + 1);
+    for (std::size_t i = 1; i <= n; ++i) {
+        p[0] = i;
+        std::size_t j0 = 0;
+        for (std::size_t j = 0; j <= n; ++j) {
+            minv[j] = INFINITY;
+            used[j] = false;
         }
-        //sort by min distance
-        std::sort(tuples.begin(),tuples.end(), [](
-            std::pair<std::shared_ptr<Cluster>,std::shared_ptr<Cluster>> &a,
-            std::pair<std::shared_ptr<Cluster>,std::shared_ptr<Cluster>> &b)->bool
-            {return a.first->getClusterDistance(a.second) > b.first->getClusterDistance(b.second);});
-        // add closest clusters to map
-        // (find 1:1 mapping such that color maps will always be kept)
-        while(tuples.size() > 0) {
-            auto cpair = tuples.back();
-            // check if cluster (pair.first) has not been mapped yet
-            if (cmap.find(cpair.first) == cmap.end()) {
-                // check if cluster (pair.second) has not been mapped yet
-                bool cluster2mapped = false;
-                for (auto &pair : cmap) {
-                    if (pair.second == cpair.second) {
-                        cluster2mapped = true;
-                    }
+        do {
+            used[j0] = true;
+            std::size_t i0 = p[j0];
+            std::size_t j1 = 0;
+            double delta = INFINITY;
+            for (std::size_t j = 1; j <= n; ++j) {
+                if (used[j])
+                    continue;
+                double cur = cost[(i0 - 1) * n + j - 1] - u[i0] - v[j];
+                if (cur < minv[j]) {
+                    minv[j] = cur;
+                    way[j] = j0;
+                }
+                if (minv[j] < delta) {
+                    delta = minv[j];
+                    j1 = j;
                 }
-                if (!cluster2mapped) {
-                    cmap.insert(cpair);
+            }
+            for (std::size_t j = 0; j <= n; ++j) {
+                if (used[j]) {
+                    u[p[j]] += delta;
+                    v[j] -= delta;
+                } else {
+                    minv[j] -= delta;
                 }
             }
-            tuples.pop_back();
+            j0 = j1;
+        } while (p[j0] != 0);
+        // augment along the path
+        do {
+            std::size_t j1 = way[j0];
+            p[j0] = p[j1];
+            j0 = j1;
+        } while (j0 != 0);
+    }
+    for (std::size_t j = 1; j <= n; ++j) {
+        rowToCol[p[j] - 1] = j - 1;
+    }
+}
+
+// minimum cost assignment between n1 and n2 centers returned by center1(i) and center2(j), see Cluster::assignClusters
+template <class Center1, class Center2>
+std::size_t assignByDistance(const Center1 &center1, std::size_t n1, const Center2 &center2, std::size_t n2, std::size_t *match)
+{
+    // square cost matrix of the center distances, padded with zero cost dummy clusters
+    const std::size_t n = std::max(n1, n2);
+    SmallBuffer<double, Cluster::maxStackClusters * Cluster::maxStackClusters> cost(n * n, 0.0);
+    for (std::size_t i = 0; i < n1; ++i) {
+        for (std::size_t j = 0; j < n2; ++j) {
+            cost[i * n + j] = (center1(i) - center2(j)).norm();
+        }
+    }
+    SmallBuffer<std::size_t, Cluster::maxStackClusters> rowToCol(n);
+    solveAssignment(cost, n, &rowToCol[0]);
+
+    std::size_t numPairs = 0;
+    for (std::size_t i = 0; i < n1; ++i) {
+        match[i] = (rowToCol[i] < n2) ? rowToCol[i] : Cluster::noMatch;
+        numPairs += (match[i] != Cluster::noMatch) ? 1 : 0;
+    }
+    return numPairs;
+}
+
+} // namespace
+
+std::size_t Cluster::assignClusters(const ClusterList &clist1, const ClusterList &clist2, std::size_t *match) {
+        return assignByDistance([&clist1](size_t i) { return clist1[i].center; }, clist1.size(),
+            [&clist2](size_t j) { return clist2[j].center; }, clist2.size(), match);
+}
+
+std::size_t Cluster::assignCenters(const std::vector<Vec2> &centers1, const std::vector<Vec2> &centers2, std::size_t *match) {
+        return assignByDistance([&centers1](size_t i) { return centers1[i]; }, centers1.size(),
+            [&centers2](size_t j) { return centers2[j]; }, centers2.size(), match);
+}
+
+Vec2 Cluster::getHub(const ClusterList &clist) {
+    Vec2 hub = Vec2::zero();
+    for (auto &cluster : clist) {
+        hub += cluster.center;
+    }
+    return hub * (1.0 / clist.size());
+}
+
+double Cluster::getRotation(const ClusterList &clist1, const ClusterList &clist2) {
+        SmallBuffer<size_t, maxStackClusters> match(clist1.size());
+        size_t numPairs = assignClusters(clist1, clist2, &match[0]);
+        if (numPairs == 0)
+            return 0.0;
+        Vec2 hub1 = getHub(clist1);
+        Vec2 hub2 = getHub(clist2);
+        // average rotation of the matched cluster centers about the hub
+        double rotation = 0.0;
+        for (size_t i = 0; i < clist1.size(); ++i) {
+            if (match[i] == noMatch)
+                continue;
+            Vec2 dir1 = clist1[i].center - hub1;
+            Vec2 dir2 = clist2[match[i]].center - hub2;
+            double delta = std::atan2(dir2[1], dir2[0]) - std::atan2(dir1[1], dir1[0]);
+            // wrap into [-pi, pi)
+            rotation += delta - 2.0 * PI * std::floor((delta + PI) / (2.0 * PI));
+        }
+        return rotation / numPairs;
+}
+
+void Cluster::rotateClusters(const ClusterList &clist, double angle, ClusterList &rotated) {
+        Vec2 hub = getHub(clist);
+        Mat2 rot{{{std::cos(angle), -std::sin(angle)}, {std::sin(angle), std::cos(angle)}}};
+        rotated.clear();
+        for (auto &cluster : clist) {
+            Vec2 center = hub + rot * (cluster.center - hub);
+            Mat2 sigma = rot * cluster.sigma * rot.transpose();
+            rotated.emplace_back(center, sigma, cluster.weighting);
         }
 }
 
 // ------------------------------ CLUSTERMODEL -------------------------
 
-void ClusterModel::runClusterFitting()
+template <std::size_t K>
+std::size_t ClusterModel<K>::numClusters() const
 {
-    double tol = 1e-6;
-    double likelihood(0);
-    double lastLikelihood(0);
-    size_t maxIt = 10;
-    size_t maxCluster = 0;
+    if constexpr (K == DynamicClusterCount)
+        return clusters.size();
+    else
+        return K;
+}
+
+template <std::size_t K>
+template <class T>
+typename ClusterModel<K>::template PerCluster<T> ClusterModel<K>::makePerCluster() const
+{
+    if constexpr (K == DynamicClusterCount)
+        return PerCluster<T>(clusters.size());
+    else
+        return PerCluster<T>{};
+}
+
+template <std::size_t K>
+bool ClusterModel<K>::prepareComponents(PerCluster<Component> &components) const
+{
+    bool success = true;
+    for (size_t k = 0; k < numClusters(); ++k) {
+        const Cluster &cluster = clusters[k];
+        Component &component = components[k];
+        component.center = cluster.center;
+        // Cholesky decomposition of sigma matrix
+        success = cluster.sigma.cholesky(component.sigmaChol) && success;
+        // normalization constant
+        double c1 = 2 * log(2 * PI) + 2 * log(component.sigmaChol[0][0]) + log(component.sigmaChol[1][1]);
+        component.logConst = -c1 / 2.0 + log(cluster.weighting);
+    }
+    return success;
+}
+
+template <std::size_t K>
+void ClusterModel<K>::buildGrid(double cellSize)
+{
+    _cells.clear();
+    if (points.empty())
+        return;
+    Vec2 minPnt = points[0];
+    Vec2 maxPnt = points[0];
+    for (auto &pnt : points) {
+        minPnt = {std::min(minPnt[0], pnt[0]), std::min(minPnt[1], pnt[1])};
+        maxPnt = {std::max(maxPnt[0], pnt[0]), std::max(maxPnt[1], pnt[1])};
+    }
+    size_t nRows = static_cast<size_t>((maxPnt[0] - minPnt[0]) / cellSize) + 1;
+    size_t nCols = static_cast<size_t>((maxPnt[1] - minPnt[1]) / cellSize) + 1;
+
+    // counting sort of the points by cell index
+    std::vector<size_t> cellIdx(points.size());
+    std::vector<size_t> cellStart(nRows * nCols + 1, 0);
+    for (size_t iPnt = 0; iPnt < points.size(); ++iPnt) {
+        size_t row = static_cast<size_t>((points[iPnt][0] - minPnt[0]) / cellSize);
+        size_t col = static_cast<size_t>((points[iPnt][1] - minPnt[1]) / cellSize);
+        cellIdx[iPnt] = row * nCols + col;
+        ++cellStart[cellIdx[iPnt] + 1];
+    }
+    std::partial_sum(cellStart.begin(), cellStart.end(), cellStart.begin());
+    std::vector<Vec2> sorted(points.size());
+    std::vector<size_t> next(cellStart.begin(), cellStart.end() - 1);
+    for (size_t iPnt = 0; iPnt < points.size(); ++iPnt) {
+        sorted[next[cellIdx[iPnt]]++] = points[iPnt];
+    }
+    points.swap(sorted);
+
+    // bounding boxes of the non-empty cells
+    for (size_t cell = 0; cell + 1 < cellStart.size(); ++cell) {
+        if (cellStart[cell] == cellStart[cell + 1])
+            continue;
+        GridCell gridCell{cellStart[cell], points[cellStart[cell]], points[cellStart[cell]]};
+        for (size_t iPnt = cellStart[cell]; iPnt < cellStart[cell + 1]; ++iPnt) {
+            gridCell.min = {std::min(gridCell.min[0], points[iPnt][0]), std::min(gridCell.min[1], points[iPnt][1])};
+            gridCell.max = {std::max(gridCell.max[0], points[iPnt][0]), std::max(gridCell.max[1], points[iPnt][1])};
+        }
+        _cells.push_back(gridCell);
+    }
+}
+
+template <std::size_t K>
+void ClusterModel<K>::getActiveClusters(const PerCluster<Component> &components, const GridCell &cell, PerCluster<char> &active) const
+{
+    size_t closest = 0;
+    double minBound = INFINITY;
+    bool anyActive = false;
+    for (size_t k = 0; k < numClusters(); ++k) {
+        // whiten the corners of the cell's bounding box with the cluster's Cholesky factor: the Mahalanobis
+        // distance of all points in the cell is bounded by the distance of the origin to the whitened box
+        const Component &component = components[k];
+        Vec2 corners[4] = {
+            component.sigmaChol.solveLower(cell.min - component.center),
+            component.sigmaChol.solveLower(Vec2{cell.min[0], cell.max[1]} - component.center),
+            component.sigmaChol.solveLower(cell.max - component.center),
+            component.sigmaChol.solveLower(Vec2{cell.max[0], cell.min[1]} - component.center)};
+        double bound = INFINITY;
+        bool inside = true;
+        double lastCross = 0.0;
+        for (size_t i = 0; i < 4; ++i) {
+            const Vec2 &a = corners[i];
+            const Vec2 &b = corners[(i + 1) % 4];
+            Vec2 edge = b - a;
+            // distance of the origin to the edge
+            double t = std::clamp(-a.dot(edge) / std::max(edge.squaredNorm(), 1e-12), 0.0, 1.0);
+            bound = std::min(bound, (a + edge * t).norm());
+            // origin inside the (convex) whitened box if it lies on the same side of all edges
+            double cross = a[0] * edge[1] - a[1] * edge[0];
+            inside = inside && (cross * lastCross >= 0.0);
+            lastCross = (cross != 0.0) ? cross : lastCross;
+        }
+        bound = (inside && lastCross != 0.0) ? 0.0 : bound;
+        active[k] = !(bound > _truncationDistance);
+        anyActive = anyActive || active[k];
+        if (bound < minBound) {
+            minBound = bound;
+            closest = k;
+        }
+    }
+    // every point needs at least one cluster
+    if (!anyActive)
+        active[closest] = true;
+}
+
+template <std::size_t K>
+inline double ClusterModel<K>::accumulatePoint(const PerCluster<Component> &components, const PerCluster<char> &active, size_t iPnt,
+    PerCluster<double> &logProb, PerCluster<Moments> &moments)
+{
+    const size_t nClusters = numClusters();
+    const Vec2 &pnt = points[iPnt];
+    // log probability of each cluster to generate this point and maximum of all clusters
+    double maxProb = -1e8;
+    for (size_t k = 0; k < nClusters; ++k) {
+        if (!active[k])
+            continue;
+        Vec2 pntNorm = components[k].sigmaChol.solveLower(pnt - components[k].center);
+        logProb[k] = components[k].logConst - pntNorm.squaredNorm() / 2.0;
+        maxProb = (logProb[k] > maxProb) ? logProb[k] : maxProb;
+    }
+
+    // switch to log form
+    double expsum = 0.0;
+    for (size_t k = 0; k < nClusters; ++k) {
+        if (active[k])
+            expsum += exp(logProb[k] - maxProb);
+    }
+    double logsum = maxProb + log(expsum);
+
+    // reverse to exponential form, accumulate weighted moments
+    // and find out for which cluster the point is most likely
     double curMax = 0.0;
-    double maxProb;
-    std::vector<double> loglikelihood(maxIt, -1e20);
+    size_t maxCluster = 0;
+    for (size_t k = 0; k < nClusters; ++k) {
+        if (!active[k])
+            continue;
+        double prob = exp(logProb[k] - logsum);
+        Vec2 dist = pnt - components[k].center;
+        moments[k].weight += prob;
+        moments[k].first += dist * prob;
+        moments[k].second += Mat2::outer(dist, dist * prob);
+        if (curMax < prob) {
+            curMax = prob;
+            maxCluster = k;
+        }
+    }
+    labels[iPnt] = static_cast<uint8_t>(maxCluster);
+    return logsum;
+}
+
+template <std::size_t K>
+double ClusterModel<K>::accumulate(const PerCluster<Component> &components, size_t begin, size_t end, PerCluster<Moments> &moments)
+{
+    PerCluster<double> logProb = makePerCluster<double>();
+    PerCluster<char> active = makePerCluster<char>();
+
+    // likelihood of all points to appear for the current set of clusters
+    double likelihood = 0.0;
+    if (!_truncate) {
+        std::fill(active.begin(), active.end(), true);
+        for (size_t iPnt = begin; iPnt < end; ++iPnt) {
+            likelihood += accumulatePoint(components, active, iPnt, logProb, moments);
+        }
+        return likelihood;
+    }
+
+    // truncated expectation step: decide per grid cell which clusters are evaluated
+    auto cell = std::upper_bound(_cells.begin(), _cells.end(), begin,
+        [](size_t pnt, const GridCell &gridCell) { return pnt < gridCell.begin; }) - 1;
+    for (size_t iPnt = begin; iPnt < end; ++cell) {
+        size_t cellEnd = (cell + 1 == _cells.end()) ? points.size() : (cell + 1)->begin;
+        getActiveClusters(components, *cell, active);
+        for (; iPnt < std::min(cellEnd, end); ++iPnt) {
+            likelihood += accumulatePoint(components, active, iPnt, logProb, moments);
+        }
+    }
+    return likelihood;
+}
+
+template <std::size_t K>
+double ClusterModel<K>::accumulateParallel(const PerCluster<Component> &components, size_t numChunks, ThreadPool &pool, PerCluster<Moments> &moments)
+{
+    size_t chunkSize = (points.size() + numChunks - 1) / numChunks;
+    std::vector<PerCluster<Moments>> chunkMoments(numChunks, makePerCluster<Moments>());
+    std::vector<std::future<double>> chunkLikelihoods;
+    // first chunk is processed by the calling thread
+    for (size_t iChunk = 1; iChunk < numChunks; ++iChunk) {
+        size_t begin = std::min(iChunk * chunkSize, points.size());
+        size_t end = std::min(begin + chunkSize, points.size());
+        chunkLikelihoods.emplace_back(pool.submit([this, &components, &chunkMoments, iChunk, begin, end]() {
+            return accumulate(components, begin, end, chunkMoments[iChunk]);
+        }));
+    }
+    double likelihood = accumulate(components, 0, std::min(chunkSize, points.size()), chunkMoments[0]);
+
+    // reduce partial likelihoods and moments in chunk order
+    for (auto &ftr : chunkLikelihoods) {
+        likelihood += pool.wait(ftr);
+    }
+    for (size_t iChunk = 0; iChunk < numChunks; ++iChunk) {
+        for (size_t k = 0; k < numClusters(); ++k) {
+            moments[k].weight += chunkMoments[iChunk][k].weight;
+            moments[k].first += chunkMoments[iChunk][k].first;
+            moments[k].second += chunkMoments[iChunk][k].second;
+        }
+    }
+    return likelihood;
+}
 
-    // initialize point probabilities for clusters
-    std::map <std::shared_ptr<Cluster>, std::vector<double>> probs;
-    for (auto cluster: clusters) {
-        probs.insert(std::make_pair(cluster, std::vector<double>(points.size(),0.0)));
+template <std::size_t K>
+void ClusterModel<K>::maximize(const PerCluster<Moments> &moments)
+{
+    for (size_t k = 0; k < numClusters(); ++k) {
+        Cluster &cluster = clusters[k];
+        const Moments &m = moments[k];
+
+        // calculate new weight
+        cluster.weighting = m.weight / points.size();
+
+        // calculate new center values (moments are relative to the previous center)
+        Vec2 shift = m.first * (1.0 / m.weight);
+        cluster.center = cluster.center + shift;
+
+        // calculate new covariance matrix wrt. the new center
+        Mat2 scatter = m.second - Mat2::outer(shift, shift) * m.weight;
+        cluster.sigma[0][0] = scatter[0][0] / (m.weight + 1.0e-6);
+        cluster.sigma[0][1] = scatter[0][1] / m.weight;
+        cluster.sigma[1][0] = cluster.sigma[0][1];
+        cluster.sigma[1][1] = scatter[1][1] / (m.weight + 1.0e-6);
     }
+}
+
+template <std::size_t K>
+FitReport ClusterModel<K>::runClusterFitting(const FitOptions &options)
+{
+    assert(K == DynamicClusterCount || clusters.size() == K);
+    if (options.pyramidLevels > 1)
+        return runCoarseToFine(options);
+    FitReport report;
+    double likelihood(0);
+    double lastLikelihood(0);
+    // minimum number of points per chunk to make a sub-task worthwhile
+    const size_t minChunkSize = 1024;
+    size_t numChunks = std::max<size_t>(1, std::min(options.numThreads, points.size() / minChunkSize));
+    labels.assign(points.size(), 0);
+    _truncationDistance = options.truncationDistance;
+    _truncate = false;
+    _cells.clear();
+    if (_truncationDistance > 0.0)
+        buildGrid(options.gridCellSize);
+
+    PerCluster<Component> components = makePerCluster<Component>();
+    PerCluster<Moments> moments = makePerCluster<Moments>();
+    PerCluster<double> lastAngles = makePerCluster<double>();
+    // deadline passed after the latest maximization step
+    bool outOfTime = false;
     // Expectation Maximization Algorithm
-    for (size_t i = 1; i < maxIt; i++)
+    for (size_t i = 0; i < options.maxIterations; i++)
     {
         // =======================================================
         // EXPECTATION STEP
         // =======================================================
         // Apply new probability model to dataset and receive new likelihoods
-        // EXPECTATIONSTEP();
-        double norm(0.0);
-        double traceSumLog(0.0);
-        double normConst(0.0);
-        
-        for (auto& cluster: clusters) {
-            cluster->expectation(points, probs[cluster]);
-            cluster->cPoints->clear();
-        }
-
-        // likelihood of all points to appear for the current set of clusters
-        double expsum;
-        double logsum;
-        likelihood = 0;
-        for (size_t iPnt = 0; iPnt < points.size(); ++iPnt)
-        {
-            // determine maximum probability for this point of all clusters
-            maxProb = -1e8;
-            for (auto& cluster: clusters) {
-                maxProb = (probs[cluster][iPnt]>maxProb)?probs[cluster][iPnt] : maxProb;
-            }
-
-            expsum = 0.0;
-            // switch to log form
-            for (auto cluster: clusters) {
-                expsum += exp(probs[cluster][iPnt] - maxProb);
-            }
-
-            logsum = maxProb + log(expsum);
-            likelihood +=logsum;
-
-            // reverse to exponential form
-            for (auto cluster:clusters) {
-                probs[cluster][iPnt] = exp(probs[cluster][iPnt] - logsum);
-            }
-
-            // find out for which cluster the point is most likely
-            curMax = 0.0;
-            std::shared_ptr<Cluster> maxCluster;
-            for (auto& cluster:clusters) {
-                if (curMax < probs[cluster][iPnt]) {
-                    curMax = probs[cluster][iPnt];
-                    maxCluster = cluster;
-                } 
-            }
-            maxCluster->cPoints->push_back(points[iPnt]);
-        } 
+        if (!prepareComponents(components)) {
+            report.choleskyFailed = true;
+            break;
+        }
+        std::fill(moments.begin(), moments.end(), Moments{});
+        if (numChunks > 1)
+            likelihood = accumulateParallel(components, numChunks, options.getThreadPool(), moments);
+        else
+            likelihood = accumulate(components, 0, points.size(), moments);
+        report.iterations = i + 1;
+        report.logLikelihood = likelihood;
+        // skip far away clusters after the first full pass
+        _truncate = !_cells.empty();
+        if (options.onIteration && !options.onIteration(report.iterations, likelihood)) {
+            report.cancelled = true;
+            return report;
+        }
+        // out of time? => return the parameters so far with their log likelihood and labels
+        if (outOfTime) {
+            report.partial = true;
+            break;
+        }
 
         // Clusters not changing anymore? => done.
-        if (std::fabs(likelihood - lastLikelihood) < tol * std::fabs(likelihood))
+        if (std::fabs(likelihood - lastLikelihood) < options.likelihoodTolerance * std::fabs(likelihood)) {
+            report.converged = true;
             break;
+        }
         lastLikelihood = likelihood;
 
+        // Cluster orientations not changing anymore? => done.
+        // (angles are defined modulo pi/2, see Cluster::getAngle)
+        if (options.angleTolerance > 0.0) {
+            double maxAngleChange = 0.0;
+            for (size_t k = 0; k < numClusters(); ++k) {
+                double angle = clusters[k].getAngle();
+                double change = angle - lastAngles[k];
+                change -= 0.5 * PI * std::round(change / (0.5 * PI));
+                // undefined angles (e.g. of the initial identity covariance) never count as converged
+                maxAngleChange = std::isnan(change) ? INFINITY : std::max(maxAngleChange, std::fabs(change));
+                lastAngles[k] = angle;
+            }
+            if (i > 0 && maxAngleChange < options.angleTolerance) {
+                report.converged = true;
+                break;
+            }
+        }
+
         // =======================================================
         // MAXIMIZATION STEP
         // =======================================================
-        for (auto cluster:clusters) {
-            cluster->maximize(points, probs[cluster]);
+        for (size_t k = 0; k < numClusters(); ++k) {
+            report.emptyCluster = report.emptyCluster || moments[k].weight < 1e-9;
         }
+        maximize(moments);
+
+        // the parameters so far are evaluated by one more expectation step before returning them
+        outOfTime = i + 1 < options.maxIterations && options.deadlinePassed();
     }
-    /* 
-    std::cout << "FITTING RESULTS" <<std::endl;
-    std::cout << "num Clusters: "<<clusters.size() <<std::endl;
-    Utility::printMatrix(clusters[0]->sigma,"sigma 0:");
-    Utility::printMatrix(clusters[1]->sigma,"sigma 1:");
-    Utility::printMatrix(clusters[2]->sigma,"sigma 2:");
-    Utility::printMatrix({clusters[0]->center,clusters[1]->center,clusters[2]->center},"center 0 1 2:");
-    */
+    return report;
+}
+
+template <std::size_t K>
+FitReport ClusterModel<K>::runCoarseToFine(const FitOptions &options)
+{
+    // minimum number of points per cluster for fitting a subsampled level
+    const size_t minLevelPoints = 50;
+    FitReport report;
+    report.levelIterations.assign(options.pyramidLevels, 0);
+    FitOptions levelOptions = options;
+    levelOptions.pyramidLevels = 1;
+    // the likelihoods of subsampled levels are on a different scale, only the full resolution reports its iterations
+    FitOptions coarseOptions = levelOptions;
+    coarseOptions.onIteration = nullptr;
+
+    // fit coarse levels, each starting from the clusters of the previous one
+    size_t stride = 1;
+    for (size_t level = 1; level < options.pyramidLevels; ++level) {
+        stride *= std::max<size_t>(options.pyramidFactor, 1);
+    }
+    for (size_t level = options.pyramidLevels - 1; level > 0; --level, stride /= std::max<size_t>(options.pyramidFactor, 1)) {
+        std::vector<Vec2> levelPoints;
+        levelPoints.reserve(points.size() / stride + 1);
+        for (size_t iPnt = 0; iPnt < points.size(); iPnt += stride) {
+            levelPoints.push_back(points[iPnt]);
+        }
+        if (levelPoints.size() < minLevelPoints * numClusters())
+            continue;
+        ClusterModel<K> levelModel(std::move(levelPoints), clusters);
+        FitReport levelReport = levelModel.runClusterFitting(coarseOptions);
+        report.levelIterations[level] = levelReport.iterations;
+        report.iterations += levelReport.iterations;
+        if (levelReport.cancelled) {
+            report.cancelled = true;
+            return report;
+        }
+        clusters = levelModel.clusters;
+        report.choleskyFailed = report.choleskyFailed || levelReport.choleskyFailed;
+        report.emptyCluster = report.emptyCluster || levelReport.emptyCluster;
+        report.partial = report.partial || levelReport.partial;
+    }
+
+    // refine on full resolution
+    levelOptions.maxIterations = options.fineIterations;
+    FitReport fineReport = runClusterFitting(levelOptions);
+    report.levelIterations[0] = fineReport.iterations;
+    report.iterations += fineReport.iterations;
+    report.logLikelihood = fineReport.logLikelihood;
+    report.converged = fineReport.converged;
+    report.choleskyFailed = report.choleskyFailed || fineReport.choleskyFailed;
+    report.emptyCluster = report.emptyCluster || fineReport.emptyCluster;
+    report.partial = report.partial || fineReport.partial;
+    report.cancelled = fineReport.cancelled;
+    return report;
 }
 
+// fits a model of K clusters and returns its clusters, (reordered) points and labels
+template <std::size_t K>
+static FitReport fitModel(std::vector<Vec2> &points, ClusterList &clusters, std::vector<uint8_t> &labels, const FitOptions &options)
+{
+    ClusterModel<K> cm(std::move(points), clusters);
+    FitReport report = cm.runClusterFitting(options);
+    clusters = cm.clusters;
+    points = std::move(cm.points);
+    labels = std::move(cm.labels);
+    return report;
+}
+
+FitReport fitClusterModel(std::vector<Vec2> &points, ClusterList &clusters, std::vector<uint8_t> &labels, const FitOptions &options)
+{
+    switch (clusters.size()) {
+    case 2:
+        return fitModel<2>(points, clusters, labels, options);
+    case 3:
+        return fitModel<3>(points, clusters, labels, options);
+    case 4:
+        return fitModel<4>(points, clusters, labels, options);
+    default:
+        return fitModel<DynamicClusterCount>(points, clusters, labels, options);
+    }
+}
+
+FitReport fitClusterModelSpeculative(std::vector<Vec2> &points, ClusterList &clusters, std::vector<uint8_t> &labels, const FitOptions &options)
+{
+    const size_t restarts = std::max<size_t>(options.restarts, 1);
+    const double spacing = 2.0 * PI / std::max<size_t>(clusters.size(), 1);
+    const double margin = options.restartCancelMargin * points.size();
+    // log likelihood of each run after each of its iterations
+    std::mutex mutex;
+    std::vector<std::vector<double>> likelihoods(restarts);
+    std::vector<ClusterList> seeds(restarts);
+    std::vector<std::vector<Vec2>> runPoints(restarts, points);
+    std::vector<std::vector<uint8_t>> runLabels(restarts);
+    std::vector<FitReport> reports(restarts);
+    auto run = [&](size_t r) {
+        FitOptions runOptions = options;
+        runOptions.onIteration = [&, r](size_t iteration, double likelihood) {
+            std::lock_guard<std::mutex> lock(mutex);
+            likelihoods[r].push_back(likelihood);
+            // the log likelihood never decreases, thus the latest value of a run which is behind in
+            // iterations is a lower bound of its value at this iteration
+            for (size_t other = 0; other < restarts; ++other) {
+                if (other == r || likelihoods[other].empty())
+                    continue;
+                if (likelihoods[other][std::min(iteration, likelihoods[other].size()) - 1] > likelihood + margin)
+                    return false;
+            }
+            return true;
+        };
+        reports[r] = fitClusterModel(runPoints[r], seeds[r], runLabels[r], runOptions);
+    };
+
+    // run the first seed in this thread and all others concurrently
+    for (size_t r = 0; r < restarts; ++r) {
+        Cluster::rotateClusters(clusters, spacing * r / restarts, seeds[r]);
+    }
+    ThreadPool &pool = options.getThreadPool();
+    std::vector<std::future<void>> futures;
+    for (size_t r = 1; r < restarts; ++r) {
+        futures.emplace_back(pool.submit([&run, r]() { run(r); }));
+    }
+    run(0);
+    for (auto &ftr : futures) {
+        pool.wait(ftr);
+    }
+
+    // best log likelihood of the runs which were not cancelled
+    size_t best = 0;
+    for (size_t r = 1; r < restarts; ++r) {
+        bool valid = !reports[r].cancelled && !reports[r].choleskyFailed;
+        bool bestValid = !reports[best].cancelled && !reports[best].choleskyFailed;
+        if (valid && (!bestValid || reports[r].logLikelihood > reports[best].logLikelihood))
+            best = r;
+    }
+    clusters = seeds[best];
+    points = std::move(runPoints[best]);
+    labels = std::move(runLabels[best]);
+    return reports[best];
+}
+
+// specializations for two, three and four bladed rotors and the runtime sized fallback
+template class ClusterModel<DynamicClusterCount>;
+template class ClusterModel<2>;
+template class ClusterModel<3>;
+template class ClusterModel<4>;
+
 #endif /* CLUSTERING_CPP_ */
\ No newline at end of file
@@ -1,21 +1,38 @@
 #ifndef CLUSTERING_H_
 #define CLUSTERING_H_
 //#define PI = 3.141592653589793238462643383279502884
-#include <map>
-#include <memory>
+#include <stdint.h>
+#include <array>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "fixed_vector.h"
+#include "small_matrix.h"
+#include "thread_pool.h"
+
+class Cluster;
+// maximum number of clusters of a frame
+constexpr std::size_t maxClusters = 16;
+// clusters of a frame, stored by value
+using ClusterList = FixedVector<Cluster, maxClusters>;
+// point label of the points which do not belong to any cluster (labels are cluster indices otherwise)
+constexpr uint8_t noLabel = 255;
+
 class Cluster {
 public:
     // Members
     // mean of cluster
-    std::vector<double> center;
+    Vec2 center;
     // covariance matrix
-    std::vector<std::vector<double>> sigma;
+    Mat2 sigma;
     // weighting wrt. other clusters
     double weighting;
-    std::shared_ptr<std::vector<std::vector<double>>> cPoints;
     // Constructor
     Cluster();
-    Cluster(std::vector<double> center, std::vector<std::vector<double>> sigma,double weighting); 
+    Cluster(Vec2 center, Mat2 sigma, double weighting); 
     /*
     // Destructor
     ~Cluster();
@@ -30,32 +47,117 @@ public:
     */
     // Functions
     // return the angle in rad of the (major) principal axis ratio and x direction (pos about z)
-    double getAngle();
+    double getAngle() const;
     // return the signal to noise ratio of this cluster
-    double getSNR();
-    // refit cluster to best fit points
-    void maximize(std::vector<std::vector<double>> points, std::vector<double> probabilities);
-    // determine probabilities for cluster to generate given set of points
-    void expectation(std::vector<std::vector<double>> points, std::vector<double>&prob);
+    double getSNR() const;
     // returns the euclidean distance between the mean of this and the provided cluster
-    double getClusterDistance(std::shared_ptr<Cluster> &cluster);
-    // returns a 1:1 map between the closest clusters in clist1 and clist2 by distance of their centers
-    static void matchClusters(const std::vector<std::shared_ptr<Cluster>>&clist1,
-        const std::vector<std::shared_ptr<Cluster>>&clist2,
-        std::map<std::shared_ptr<Cluster>,std::shared_ptr<Cluster>> &cmap);
+    double getClusterDistance(const Cluster &cluster) const;
+    // marks a cluster without partner in assignClusters
+    static constexpr std::size_t noMatch = static_cast<std::size_t>(-1);
+    // number of clusters up to which assignClusters works on stack storage only
+    static constexpr std::size_t maxStackClusters = maxClusters;
+    // minimum cost 1:1 assignment between the clusters in clist1 and clist2 by distance of their centers
+    // (exact, extra clusters of the longer list stay unmatched). match[i] receives the index in clist2
+    // of the partner of clist1[i] or noMatch and must hold clist1.size() entries. Returns the number of pairs
+    static std::size_t assignClusters(const ClusterList &clist1,
+        const ClusterList &clist2, std::size_t *match);
+    // minimum cost 1:1 assignment between two sets of cluster centers, see assignClusters
+    static std::size_t assignCenters(const std::vector<Vec2> &centers1, const std::vector<Vec2> &centers2, std::size_t *match);
+    // returns the common center of the given clusters (i.e. the rotor hub for a cluster per blade)
+    static Vec2 getHub(const ClusterList &clist);
+    // returns the rotation in rad of the clusters about their hub from clist1 to clist2
+    static double getRotation(const ClusterList &clist1, const ClusterList &clist2);
+    // returns copies of the given clusters rotated by angle (rad) about their hub
+    static void rotateClusters(const ClusterList &clist, double angle, ClusterList &rotated);
+};
+
+
+// convergence policy of the expectation maximization
+struct FitOptions
+{
+    // relative change of the log likelihood between two iterations below which the fit has converged
+    double likelihoodTolerance{1e-6};
+    // maximum number of iterations (expectation steps)
+    std::size_t maxIterations{9};
+    // change of all cluster angles (rad) between two iterations below which the fit has converged (0: disabled)
+    double angleTolerance{0.0};
+    // threads used to split the points of the expectation step
+    std::size_t numThreads{1};
+    // pool running the chunks of the expectation step and the speculative restarts (nullptr: default pool)
+    ThreadPool *threadPool{nullptr};
+    // Mahalanobis distance beyond which clusters are skipped in the expectation step (0: disabled).
+    // After a first full pass, the points are binned in a coarse grid and a cluster is only evaluated
+    // for the points of a grid cell if a lower bound of its Mahalanobis distance to the cell is below the cutoff
+    double truncationDistance{0.0};
+    // edge length of the grid cells used for the truncated expectation step (in point coordinates)
+    double gridCellSize{0.5};
+    // number of resolution levels of the coarse-to-fine fitting (1: full resolution only). The coarsest
+    // levels are fitted on every pyramidFactor^level-th point, each level starting from the previous result
+    std::size_t pyramidLevels{1};
+    // subsampling factor between two resolution levels
+    std::size_t pyramidFactor{4};
+    // maximum number of iterations on the full resolution level of a coarse-to-fine fitting
+    std::size_t fineIterations{2};
+    // number of initializations fitted concurrently by fitClusterModelSpeculative (1: single fit). The seeds
+    // are rotated about their hub by fractions of the cluster spacing, the best log likelihood wins
+    std::size_t restarts{1};
+    // log likelihood per point by which a run has to trail another run (at the same iteration) to be cancelled
+    double restartCancelMargin{0.05};
+    // called after each expectation step with the number of iterations and the log likelihood,
+    // the fit is cancelled if it returns false
+    std::function<bool(std::size_t, double)> onIteration;
+    // point in time by which the fit has to return (live processing). When it has passed, the fit stops after
+    // the current iteration and returns the parameters so far, flagged as partial (default: no deadline)
+    std::chrono::steady_clock::time_point deadline{std::chrono::steady_clock::time_point::max()};
+
+    // returns the pool of the sub-tasks of the fit
+    ThreadPool &getThreadPool() const { return threadPool ? *threadPool : ThreadPool::getDefault(); }
+    // returns true if the deadline has passed
+    bool deadlinePassed() const
+    {
+        return deadline != std::chrono::steady_clock::time_point::max() && std::chrono::steady_clock::now() >= deadline;
+    }
+};
+
+// telemetry of a single cluster fitting
+struct FitReport
+{
+    // number of iterations (expectation steps) run
+    std::size_t iterations{0};
+    // log likelihood of the points in the last expectation step
+    double logLikelihood{0.0};
+    // true if the convergence criteria were met before running out of iterations
+    bool converged{false};
+    // true if the covariance matrix of a cluster was not positive definite (fit stopped)
+    bool choleskyFailed{false};
+    // true if a cluster lost (almost) all of its weight
+    bool emptyCluster{false};
+    // true if the fit was cancelled by FitOptions::onIteration
+    bool cancelled{false};
+    // true if the fit stopped at FitOptions::deadline before it converged (parameters of the last iteration,
+    // evaluated by one more expectation step for the log likelihood and labels)
+    bool partial{false};
+    // number of iterations per resolution level of a coarse-to-fine fitting (level 0: full resolution)
+    std::vector<std::size_t> levelIterations;
 };
 
+// number of clusters of a ClusterModel which is only known at runtime
+constexpr std::size_t DynamicClusterCount = 0;
 
+// Gaussian mixture model of K clusters. For K > 0 the number of clusters is fixed at compile time,
+// such that the loops over clusters in the per-point kernel are fully unrolled and all per-cluster
+// state lives in stack arrays. K = DynamicClusterCount is the fallback for a runtime number of clusters.
+template <std::size_t K = DynamicClusterCount>
 class ClusterModel
 {
 public:
-    // vector of cluster pointers of current cluster model
-    std::vector<std::shared_ptr<Cluster>> clusters;
-    // vector of points which are to be clustered
-    std::vector<std::vector<double>> points;
+    // clusters of current cluster model
+    ClusterList clusters;
+    // vector of points which are to be clustered (reordered by the truncated expectation step)
+    std::vector<Vec2> points;
 
     // Constructor
-    ClusterModel(std::vector<std::vector<double>> points, std::vector<std::shared_ptr<Cluster>> &clusters) : points(points) , clusters(clusters) {};
+    ClusterModel(std::vector<Vec2> points, const ClusterList &clusters) : clusters(clusters), points(std::move(points)) {};
     /*
     // Copy constructor
     ClusterModel(const ClusterModel&) = delete;
@@ -70,11 +172,82 @@ public:
     ClusterModel& operator=(ClusterModel&&) = delete;
     */
 public:
-    // finds best fit for clusters by expectation maximization
-    void runClusterFitting();
+    // cluster index each point is most likely generated by (after fitting)
+    std::vector<uint8_t> labels;
+
+    // finds best fit for clusters by expectation maximization. With options.numThreads > 1 the points are split
+    // into chunks whose moments and likelihoods are computed concurrently and reduced afterwards
+    FitReport runClusterFitting(const FitOptions &options = FitOptions());
     // prints a matrix (for debugging purposes)
     static void printMat(const std::vector<std::vector<double>>& mat, std::string title);
+
+private:
+    // per-cluster storage: stack array for a fixed number of clusters, vector for the runtime fallback
+    template <class T>
+    using PerCluster = std::conditional_t<K == DynamicClusterCount, std::vector<T>, std::array<T, K>>;
+
+    // precomputed quantities of a cluster for evaluating its log density
+    struct Component {
+        Vec2 center;
+        Mat2 sigmaChol;
+        double logConst;
+    };
+
+    // cell of the grid over the points: the points [begin, next cell's begin) and their bounding box
+    struct GridCell {
+        std::size_t begin;
+        Vec2 min;
+        Vec2 max;
+    };
+
+    // grid cells over the points sorted by cell (empty if the expectation step is not truncated)
+    std::vector<GridCell> _cells;
+    // Mahalanobis distance beyond which clusters are skipped for a grid cell
+    double _truncationDistance{0.0};
+    // true once the expectation step may skip clusters (after the first full pass)
+    bool _truncate{false};
+
+    // weighted moments of the points wrt. a cluster, relative to the cluster center before the update
+    struct Moments {
+        double weight{0.0};
+        Vec2 first{};
+        Mat2 second{};
+    };
+
+    // number of clusters of this model
+    std::size_t numClusters() const;
+    // returns a per-cluster array sized for this model
+    template <class T>
+    PerCluster<T> makePerCluster() const;
+    // precomputes the log density parameters of all clusters. Returns false if a Cholesky decomposition failed
+    bool prepareComponents(PerCluster<Component> &components) const;
+    // fits the clusters on subsampled points first and refines the result on all points
+    FitReport runCoarseToFine(const FitOptions &options);
+    // sorts the points into grid cells of the given size
+    void buildGrid(double cellSize);
+    // flags the clusters which have to be evaluated for the points of a grid cell
+    void getActiveClusters(const PerCluster<Component> &components, const GridCell &cell, PerCluster<char> &active) const;
+    // expectation step for a single point considering only the active clusters: accumulates the weighted moments,
+    // stores the most likely cluster of the point and returns its log likelihood
+    double accumulatePoint(const PerCluster<Component> &components, const PerCluster<char> &active, std::size_t iPnt,
+        PerCluster<double> &logProb, PerCluster<Moments> &moments);
+    // expectation step for the points [begin, end): accumulates the weighted moments of each cluster,
+    // stores the most likely cluster of each point and returns the log likelihood of the points
+    double accumulate(const PerCluster<Component> &components, std::size_t begin, std::size_t end, PerCluster<Moments> &moments);
+    // expectation step for all points split into numChunks chunks which are processed concurrently on the pool
+    double accumulateParallel(const PerCluster<Component> &components, std::size_t numChunks, ThreadPool &pool, PerCluster<Moments> &moments);
+    // maximization step: updates all clusters from the accumulated moments
+    void maximize(const PerCluster<Moments> &moments);
 };
 
+// fits the given clusters to the points by expectation maximization, using the compile-time
+// specialized model for two, three or four clusters and the runtime sized model otherwise.
+// Returns the label of each point in labels (the points may be reordered)
+FitReport fitClusterModel(std::vector<Vec2> &points, ClusterList &clusters, std::vector<uint8_t> &labels, const FitOptions &options = FitOptions());
+
+// fits options.restarts rotated copies of the given clusters concurrently and returns the best fit in clusters.
+// After each iteration the runs compare their log likelihoods, runs clearly behind another run are cancelled
+FitReport fitClusterModelSpeculative(std::vector<Vec2> &points, ClusterList &clusters, std::vector<uint8_t> &labels, const FitOptions &options = FitOptions());
+
 #endif // CLUSTERING_H_
 
@@ -0,0 +1,120 @@
+#ifndef CONNECTED_COMPONENTS_CPP_
+#define CONNECTED_COMPONENTS_CPP_
+#include <algorithm>
+#include <math.h>
+
+#include "connected_components.h"
+
+ConnectedComponents::ConnectedComponents(std::vector<Vec2> pointsIn, double scale, double minComponentFraction) :
+    points(std::move(pointsIn)), _scale(scale), _minComponentFraction(minComponentFraction) {}
+
+size_t ConnectedComponents::find(size_t i)
+{
+    while (_parent[i] != i) {
+        _parent[i] = _parent[_parent[i]];
+        i = _parent[i];
+    }
+    return i;
+}
+
+void ConnectedComponents::unite(size_t i, size_t j)
+{
+    i = find(i);
+    j = find(j);
+    if (i == j)
+        return;
+    if (_moments[i].count < _moments[j].count)
+        std::swap(i, j);
+    _parent[j] = i;
+    _moments[i].count += _moments[j].count;
+    _moments[i].first += _moments[j].first;
+    _moments[i].second += _moments[j].second;
+}
+
+bool ConnectedComponents::run()
+{
+    const size_t n = points.size();
+    // pixel coordinates in raster order (as extracted from the image)
+    std::vector<long> rows(n), cols(n);
+    for (size_t i = 0; i < n; ++i) {
+        rows[i] = std::lround(points[i][0] * _scale);
+        cols[i] = std::lround(points[i][1] * _scale);
+    }
+    std::vector<size_t> order(n);
+    for (size_t i = 0; i < n; ++i) {
+        order[i] = i;
+    }
+    auto rasterLess = [&rows, &cols](size_t a, size_t b) { return rows[a] < rows[b] || (rows[a] == rows[b] && cols[a] < cols[b]); };
+    if (!std::is_sorted(order.begin(), order.end(), rasterLess)) {
+        std::sort(order.begin(), order.end(), rasterLess);
+    }
+
+    // single raster scan: each point is joined with its left neighbour and its three neighbours in the
+    // previous row, which are found by a pointer moving along the previous row
+    _parent.resize(n);
+    _moments.assign(n, Moments());
+    size_t prevRowBegin = 0;
+    size_t prevRowEnd = 0;
+    size_t curRowBegin = 0;
+    size_t prevPointer = 0;
+    for (size_t pos = 0; pos < n; ++pos) {
+        size_t i = order[pos];
+        _parent[i] = i;
+        if (pos > curRowBegin && rows[order[pos - 1]] != rows[i]) {
+            // new row, the previous row is only searched if it is adjacent
+            bool adjacent = rows[order[pos - 1]] == rows[i] - 1;
+            prevRowBegin = adjacent ? curRowBegin : pos;
+            prevRowEnd = pos;
+            curRowBegin = pos;
+            prevPointer = prevRowBegin;
+        }
+        _moments[i].count = 1.0;
+        _moments[i].first = points[i];
+        _moments[i].second = Mat2::outer(points[i], points[i]);
+        if (pos > curRowBegin && cols[order[pos - 1]] == cols[i] - 1) {
+            unite(i, order[pos - 1]);
+        }
+        while (prevPointer < prevRowEnd && cols[order[prevPointer]] < cols[i] - 1) {
+            ++prevPointer;
+        }
+        for (size_t prev = prevPointer; prev < prevRowEnd && cols[order[prev]] <= cols[i] + 1; ++prev) {
+            unite(i, order[prev]);
+        }
+    }
+
+    // blade components: all components above the noise size
+    _blades.clear();
+    for (size_t i = 0; i < n; ++i) {
+        if (_parent[i] == i && _moments[i].count >= _minComponentFraction * n) {
+            _blades.push_back(i);
+        }
+    }
+    if (_blades.size() != numBlades)
+        return false;
+    labels.assign(n, noBlade);
+    for (size_t i = 0; i < n; ++i) {
+        size_t root = find(i);
+        for (size_t k = 0; k < numBlades; ++k) {
+            if (_blades[k] == root)
+                labels[i] = static_cast<uint8_t>(k);
+        }
+    }
+    return true;
+}
+
+void ConnectedComponents::getClusters(ClusterList &clusters) const
+{
+    clusters.clear();
+    double total = 0.0;
+    for (auto root : _blades) {
+        total += _moments[root].count;
+    }
+    for (auto root : _blades) {
+        const Moments &moments = _moments[root];
+        Vec2 mean = moments.first * (1.0 / moments.count);
+        Mat2 sigma = moments.second * (1.0 / moments.count) - Mat2::outer(mean, mean);
+        clusters.emplace_back(mean, sigma, moments.count / total);
+    }
+}
+
+#endif /* CONNECTED_COMPONENTS_CPP_ */
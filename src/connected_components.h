@@ -0,0 +1,58 @@
+#ifndef CONNECTED_COMPONENTS_H_
+#define CONNECTED_COMPONENTS_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include "clustering.h"
+
+// Labels the 8-connected components of the rotor blade points in a single raster scan with union-find,
+// accumulating the moments (point count, mean, covariance) of each component on the fly. Components
+// smaller than a fraction of all points are dropped as noise. If the blades are visually separated, the
+// remaining components are the blade clusters without any iterative fitting; if components merge (e.g.
+// near the hub or where blades overlap the tower), the caller falls back to expectation maximization.
+class ConnectedComponents
+{
+public:
+    // number of blades of the rotor
+    static constexpr std::size_t numBlades = 3;
+    // label of points which belong to no blade
+    static constexpr uint8_t noBlade = noLabel;
+
+    // vector of points which are to be labeled (scaled pixel coordinates)
+    std::vector<Vec2> points;
+    // blade index of each point (noBlade for noise) after a successful run
+    std::vector<uint8_t> labels;
+
+    // Constructor (scale of the points wrt. pixel coordinates)
+    ConnectedComponents(std::vector<Vec2> points, double scale, double minComponentFraction = 0.05);
+
+    // labels the components, returns true if exactly numBlades components remain after dropping noise
+    bool run();
+    // returns the blades as clusters (labels are the blade indices)
+    void getClusters(ClusterList &clusters) const;
+
+private:
+    // moments of a component
+    struct Moments
+    {
+        double count{0.0};
+        Vec2 first{Vec2::zero()};
+        Mat2 second{Mat2::zero()};
+    };
+
+    double _scale;
+    double _minComponentFraction;
+    // union-find parent of each point and moments of each root
+    std::vector<std::size_t> _parent;
+    std::vector<Moments> _moments;
+    // roots of the blade components
+    std::vector<std::size_t> _blades;
+
+    // returns the root of the component of point i (path halving)
+    std::size_t find(std::size_t i);
+    // merges the components of points i and j (union by size, moments are summed in the new root)
+    void unite(std::size_t i, std::size_t j);
+};
+
+#endif // CONNECTED_COMPONENTS_H_
@@ -0,0 +1,58 @@
+#ifndef FFT_CPP_
+#define FFT_CPP_
+# define PI           3.14159265358979323846
+#include <math.h>
+#include <utility>
+
+#include "fft.h"
+
+FFT::FFT(size_t size)
+{
+    _size = 1;
+    size_t bits = 0;
+    while (_size < size) {
+        _size <<= 1;
+        ++bits;
+    }
+    _twiddles.resize(_size / 2);
+    for (size_t k = 0; k < _size / 2; ++k) {
+        _twiddles[k] = std::polar(1.0, -2.0 * PI * k / _size);
+    }
+    _bitReversal.resize(_size);
+    for (size_t i = 0; i < _size; ++i) {
+        size_t reversed = 0;
+        for (size_t bit = 0; bit < bits; ++bit) {
+            reversed |= ((i >> bit) & 1) << (bits - 1 - bit);
+        }
+        _bitReversal[i] = reversed;
+    }
+}
+
+void FFT::transform(std::vector<std::complex<double>> &data, bool inverse) const
+{
+    data.resize(_size);
+    for (size_t i = 0; i < _size; ++i) {
+        if (i < _bitReversal[i])
+            std::swap(data[i], data[_bitReversal[i]]);
+    }
+    // butterflies of length len use every (size / len)-th twiddle factor
+    for (size_t len = 2; len <= _size; len <<= 1) {
+        size_t half = len / 2;
+        size_t stride = _size / len;
+        for (size_t start = 0; start < _size; start += len) {
+            for (size_t k = 0; k < half; ++k) {
+                std::complex<double> w = inverse ? std::conj(_twiddles[k * stride]) : _twiddles[k * stride];
+                std::complex<double> odd = data[start + k + half] * w;
+                data[start + k + half] = data[start + k] - odd;
+                data[start + k] += odd;
+            }
+        }
+    }
+    if (inverse) {
+        for (auto &value : data) {
+            value /= static_cast<double>(_size);
+        }
+    }
+}
+
+#endif /* FFT_CPP_ */
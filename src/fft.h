@@ -0,0 +1,29 @@
+#ifndef FFT_H_
+#define FFT_H_
+
+#include <complex>
+#include <vector>
+
+// Plan of an iterative radix-2 fast Fourier transform of a fixed size (power of two). Twiddle factors and
+// the bit reversal permutation are precomputed once, so repeated transforms of the same size only run the
+// butterflies on the caller's buffer.
+class FFT
+{
+public:
+    // Constructor: size is rounded up to a power of two
+    FFT(std::size_t size);
+
+    // transforms the data in place (forward: exp(-i...), inverse: exp(+i...) scaled by 1/size)
+    void transform(std::vector<std::complex<double>> &data, bool inverse = false) const;
+    // returns the size of the transform
+    std::size_t size() const { return _size; }
+
+private:
+    std::size_t _size;
+    // exp(-2 pi i k / size) for k < size / 2
+    std::vector<std::complex<double>> _twiddles;
+    // bit reversed index of each index
+    std::vector<std::size_t> _bitReversal;
+};
+
+#endif // FFT_H_
@@ -0,0 +1,63 @@
+#ifndef FIXED_VECTOR_H_
+#define FIXED_VECTOR_H_
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <utility>
+
+// Vector of at most N elements stored in place (no heap allocation, copied by value). Intended for the few
+// clusters of a frame, exceeding the capacity is a programming error.
+template <class T, std::size_t N>
+class FixedVector
+{
+public:
+    using value_type = T;
+    using iterator = T *;
+    using const_iterator = const T *;
+
+    std::size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+    static constexpr std::size_t capacity() { return N; }
+
+    T &operator[](std::size_t i) { return _data[i]; }
+    const T &operator[](std::size_t i) const { return _data[i]; }
+    T &front() { return _data[0]; }
+    const T &front() const { return _data[0]; }
+    T &back() { return _data[_size - 1]; }
+    const T &back() const { return _data[_size - 1]; }
+
+    iterator begin() { return _data.data(); }
+    iterator end() { return _data.data() + _size; }
+    const_iterator begin() const { return _data.data(); }
+    const_iterator end() const { return _data.data() + _size; }
+
+    void clear() { _size = 0; }
+    void push_back(const T &value)
+    {
+        assert(_size < N);
+        _data[_size++] = value;
+    }
+    template <class... Args>
+    T &emplace_back(Args &&...args)
+    {
+        assert(_size < N);
+        _data[_size] = T(std::forward<Args>(args)...);
+        return _data[_size++];
+    }
+    void pop_back() { --_size; }
+    void resize(std::size_t size)
+    {
+        assert(size <= N);
+        for (std::size_t i = _size; i < size; ++i) {
+            _data[i] = T();
+        }
+        _size = size;
+    }
+
+private:
+    std::array<T, N> _data{};
+    std::size_t _size{0};
+};
+
+#endif // FIXED_VECTOR_H_
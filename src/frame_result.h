@@ -0,0 +1,28 @@
+#ifndef FRAME_RESULT_H_
+#define FRAME_RESULT_H_
+
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+
+#include "clustering.h"
+#include "angular_correlation.h"
+
+// result of the analysis of a single frame
+struct FrameResult
+{
+    // fitted rotor blade clusters
+    ClusterList clusters;
+    // extracted rotor blade points (scaled pixel coordinates) and the index of the cluster each point
+    // belongs to (noLabel if none)
+    std::vector<Vec2> points;
+    std::vector<uint8_t> labels;
+    // telemetry of the fitting
+    FitReport report;
+    // rotor angle in rad (defined modulo 2 pi / number of blades) if estimated directly, NaN otherwise
+    double rotorAngle{NAN};
+    // spectrum of the angular profile of the points (angular correlation engine only)
+    AngularCorrelation::Spectrum angularSpectrum;
+};
+
+#endif // FRAME_RESULT_H_
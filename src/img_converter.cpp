@@ -88,6 +88,30 @@ void ImgConverter::setRGBValue(const Point point, const std::vector<uint8_t> &rg
     }        
 }
 
+// returns the mean of the rgb channels of a pixel
+float ImgConverter::getIntensity(const size_t row, const size_t col) const {
+    if (_img == NULL || row >= _height || col >= _width)
+        return 0.0f;
+    const uint8_t *rgbVal = _img + (row * _width + col) * _nbChannels;
+    return (rgbVal[0] + rgbVal[1] + rgbVal[2]) / 3.0f;
+}
+
+// returns true if the pixel is above the rgb threshold and its channels vary less than the variance threshold
+bool ImgConverter::isAboveThreshold(const size_t row, const size_t col, const std::vector<uint8_t> &threshold, const double varianceThreshold) const {
+    if (_img == NULL || row >= _height || col >= _width)
+        return false;
+    const uint8_t *rgbVal = _img + (row * _width + col) * _nbChannels;
+    bool aboveThreshold = false;
+    double mean = 0.0;
+    for (size_t channel = 0; channel < _nbChannels; ++channel) {
+        aboveThreshold = (aboveThreshold || rgbVal[channel] > threshold[channel]) ? true : false;
+        mean += rgbVal[channel];
+    }
+    mean /=3.0;
+    double variance = pow(rgbVal[0]-mean,2)+pow(rgbVal[1]-mean,2)+pow(rgbVal[2]-mean,2);
+    return aboveThreshold && variance < varianceThreshold;
+}
+
 // returns a list of points above rgb threshold in defined region of interest
 void ImgConverter::getPointsInROIAboveThreshold (const ROI roi, const std::vector<uint8_t> threshold, const double varianceThreshold, std::shared_ptr<PointList> points) {
     // limit region of interest to image boundaries
@@ -95,21 +119,11 @@ void ImgConverter::getPointsInROIAboveThreshold (const ROI roi, const std::vecto
     int maxCol = (roi.maxCol > _width) ? _width : roi.maxCol;
     int minRow = (roi.minRow < 0) ? 0 : roi.minRow;
     int maxRow = (roi.maxRow > _height) ? _height : roi.maxRow;
-    std::vector<uint8_t> rgbVal = {0,0,0};
 
     // iterate of region of interest and check whether rgb values are above threshold
     for (size_t row = minRow; row < maxRow; ++row) {
         for (size_t col = minCol; col < maxCol; ++col) {
-            getRGBValue({row, col}, rgbVal);
-            bool aboveThreshold = false;
-            double mean = 0.0;
-            for (size_t channel = 0; channel < _nbChannels; ++channel) {
-                aboveThreshold = (aboveThreshold || rgbVal[channel] > threshold[channel]) ? true : false;
-                mean += rgbVal[channel];
-            }
-            mean /=3.0;
-            double variance = pow(rgbVal[0]-mean,2)+pow(rgbVal[1]-mean,2)+pow(rgbVal[2]-mean,2);
-            if(aboveThreshold && variance < varianceThreshold) points->push_back({row,col});
+            if (isAboveThreshold(row, col, threshold, varianceThreshold)) points->push_back({row,col});
         }
     }
 }
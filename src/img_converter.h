@@ -62,6 +62,13 @@ public:
     // sets the rgb value of a pixel in loaded image to specified color
     void setRGBValue(const Point point, const std::vector<uint8_t> &rgbVal);
 
+    // returns true if the pixel is above the rgb threshold in any channel and its channels vary less than the
+    // variance threshold (false if out of bound or no image is loaded)
+    bool isAboveThreshold(const size_t row, const size_t col, const std::vector<uint8_t> &threshold, const double varianceThreshold) const;
+
+    // returns the mean of the rgb channels of a pixel (0 if out of bound or no image is loaded)
+    float getIntensity(const size_t row, const size_t col) const;
+
     // returns a list of points above rgb threshold in defined region of interest
     void getPointsInROIAboveThreshold (const ROI roi, const std::vector<uint8_t> threshold, const double varianceThreshold, std::shared_ptr<PointList> points);
 
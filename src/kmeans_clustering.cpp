@@ -0,0 +1,162 @@
+#ifndef KMEANS_CLUSTERING_CPP_
+#define KMEANS_CLUSTERING_CPP_
+
+#include <algorithm>
+#include <limits>
+#include <math.h>
+
+#include "kmeans_clustering.h"
+
+void KMeansModel::assignPoint(size_t iPnt, const std::vector<Vec2> &centers)
+{
+    double minDist = std::numeric_limits<double>::max();
+    double secondDist = std::numeric_limits<double>::max();
+    size_t minCluster = 0;
+    for (size_t k = 0; k < centers.size(); ++k) {
+        double dist = (points[iPnt] - centers[k]).squaredNorm();
+        if (dist < minDist) {
+            secondDist = minDist;
+            minDist = dist;
+            minCluster = k;
+        } else if (dist < secondDist) {
+            secondDist = dist;
+        }
+    }
+    labels[iPnt] = static_cast<uint8_t>(minCluster);
+    _upperBounds[iPnt] = std::sqrt(minDist);
+    _lowerBounds[iPnt] = std::sqrt(secondDist);
+}
+
+FitReport KMeansModel::runClusterFitting(const FitOptions &options)
+{
+    FitReport report;
+    const size_t nClusters = clusters.size();
+    const size_t nPoints = points.size();
+    labels.assign(nPoints, 0);
+    _upperBounds.assign(nPoints, 0.0);
+    _lowerBounds.assign(nPoints, 0.0);
+
+    std::vector<Vec2> centers(nClusters);
+    std::vector<Vec2> sums(nClusters, Vec2::zero());
+    std::vector<size_t> counts(nClusters, 0);
+    // half distance of each center to its closest other center
+    std::vector<double> halfMinDist(nClusters);
+    // distance each center moved in the last update
+    std::vector<double> moved(nClusters);
+    for (size_t k = 0; k < nClusters; ++k) {
+        centers[k] = clusters[k].center;
+    }
+
+    // initial assignment to the seeded centers
+    for (size_t iPnt = 0; iPnt < nPoints; ++iPnt) {
+        assignPoint(iPnt, centers);
+        sums[labels[iPnt]] += points[iPnt];
+        ++counts[labels[iPnt]];
+    }
+
+    for (size_t i = 0; i < options.maxIterations; ++i)
+    {
+        report.iterations = i + 1;
+
+        // move centers to the mean of their assigned points
+        size_t maxMoved = 0;
+        for (size_t k = 0; k < nClusters; ++k) {
+            Vec2 newCenter = (counts[k] > 0) ? sums[k] * (1.0 / counts[k]) : centers[k];
+            moved[k] = (newCenter - centers[k]).norm();
+            centers[k] = newCenter;
+            maxMoved = (moved[k] > moved[maxMoved]) ? k : maxMoved;
+        }
+        double secondMoved = 0.0;
+        for (size_t k = 0; k < nClusters; ++k) {
+            if (k != maxMoved)
+                secondMoved = std::max(secondMoved, moved[k]);
+        }
+
+        // update distance bounds by the center movements
+        for (size_t iPnt = 0; iPnt < nPoints; ++iPnt) {
+            size_t label = labels[iPnt];
+            _upperBounds[iPnt] += moved[label];
+            _lowerBounds[iPnt] -= (label == maxMoved) ? secondMoved : moved[maxMoved];
+        }
+
+        for (size_t k = 0; k < nClusters; ++k) {
+            double minDist = std::numeric_limits<double>::max();
+            for (size_t j = 0; j < nClusters; ++j) {
+                if (j != k)
+                    minDist = std::min(minDist, (centers[k] - centers[j]).norm());
+            }
+            halfMinDist[k] = 0.5 * minDist;
+        }
+
+        // reassign points whose bounds do not guarantee the assigned center to be the closest
+        size_t changed = 0;
+        for (size_t iPnt = 0; iPnt < nPoints; ++iPnt) {
+            size_t label = labels[iPnt];
+            double bound = std::max(halfMinDist[label], _lowerBounds[iPnt]);
+            if (_upperBounds[iPnt] <= bound)
+                continue;
+            // tighten upper bound and test again
+            _upperBounds[iPnt] = (points[iPnt] - centers[label]).norm();
+            if (_upperBounds[iPnt] <= bound)
+                continue;
+            assignPoint(iPnt, centers);
+            if (labels[iPnt] != label) {
+                sums[label] = sums[label] - points[iPnt];
+                --counts[label];
+                sums[labels[iPnt]] += points[iPnt];
+                ++counts[labels[iPnt]];
+                ++changed;
+            }
+        }
+
+        // Assignments not changing anymore? => done.
+        if (changed == 0) {
+            report.converged = true;
+            break;
+        }
+
+        // out of time? => return the centers so far
+        if (i + 1 < options.maxIterations && options.deadlinePassed()) {
+            report.partial = true;
+            break;
+        }
+    }
+
+    computeCovariances(report);
+    return report;
+}
+
+void KMeansModel::computeCovariances(FitReport &report)
+{
+    const size_t nClusters = clusters.size();
+    std::vector<Vec2> sums(nClusters, Vec2::zero());
+    std::vector<size_t> counts(nClusters, 0);
+    for (size_t iPnt = 0; iPnt < points.size(); ++iPnt) {
+        sums[labels[iPnt]] += points[iPnt];
+        ++counts[labels[iPnt]];
+    }
+    for (size_t k = 0; k < nClusters; ++k) {
+        if (counts[k] == 0) {
+            report.emptyCluster = true;
+            continue;
+        }
+        clusters[k].center = sums[k] * (1.0 / counts[k]);
+        clusters[k].sigma = Mat2::zero();
+        clusters[k].weighting = static_cast<double>(counts[k]) / points.size();
+    }
+
+    double sumSquaredDist = 0.0;
+    for (size_t iPnt = 0; iPnt < points.size(); ++iPnt) {
+        Cluster &cluster = clusters[labels[iPnt]];
+        Vec2 dist = points[iPnt] - cluster.center;
+        cluster.sigma += Mat2::outer(dist, dist);
+        sumSquaredDist += dist.squaredNorm();
+    }
+    for (size_t k = 0; k < nClusters; ++k) {
+        if (counts[k] > 0)
+            clusters[k].sigma = clusters[k].sigma * (1.0 / counts[k]);
+    }
+    report.logLikelihood = -0.5 * sumSquaredDist;
+}
+
+#endif /* KMEANS_CLUSTERING_CPP_ */
@@ -0,0 +1,45 @@
+#ifndef KMEANS_CLUSTERING_H_
+#define KMEANS_CLUSTERING_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include "clustering.h"
+
+// Hard-assignment alternative to the Gaussian mixture model (k-means / classification EM).
+// Each point belongs to its closest cluster center only, so no densities (exp/log) are evaluated.
+// Distance computations are pruned by Hamerly's bounds: for every point an upper bound of the
+// distance to its assigned center and a lower bound of the distance to all other centers are kept,
+// which makes most points skip the search for their closest center once the centers settle.
+// Covariance matrices and weightings are computed once after convergence from the assigned points,
+// such that the fitted clusters can be used like the ones of a ClusterModel (e.g. Cluster::getAngle).
+class KMeansModel
+{
+public:
+    // clusters of current cluster model
+    ClusterList clusters;
+    // vector of points which are to be clustered
+    std::vector<Vec2> points;
+    // cluster index each point is assigned to (after fitting)
+    std::vector<uint8_t> labels;
+
+    // Constructor
+    KMeansModel(std::vector<Vec2> points, const ClusterList &clusters) : clusters(clusters), points(std::move(points)) {};
+
+    // assigns points to their closest cluster center until no assignments change. The reported
+    // log likelihood is the negative half sum of squared distances of the points to their centers
+    FitReport runClusterFitting(const FitOptions &options = FitOptions());
+
+private:
+    // upper bound of the distance of each point to its assigned center
+    std::vector<double> _upperBounds;
+    // lower bound of the distance of each point to all other centers
+    std::vector<double> _lowerBounds;
+
+    // finds the closest and second closest center of a point and updates its label and bounds
+    void assignPoint(std::size_t iPnt, const std::vector<Vec2> &centers);
+    // sets covariance matrices and weightings of the clusters from the assigned points
+    void computeCovariances(FitReport &report);
+};
+
+#endif // KMEANS_CLUSTERING_H_
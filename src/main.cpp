@@ -13,17 +13,39 @@
 
 // multi-threading
 #include <thread>
-#include <future>
 #include <queue>
 #include <mutex>
 #include <chrono>
+#include <numeric>
 
+#include "blade_tracker.h"
 #include "clustering.h"
 #include "img_converter.h"
 #include "parallel_image_processor.h"
+#include "pipeline.h"
+#include "rotor_window_fit.h"
+#include "ring_spectrum.h"
+#include "rotor_tracker.h"
+#include "optical_flow.h"
 
 # define PI0_5           1.570796327
 
+// a frame passing through the stages of the processing pipeline
+struct FrameJob
+{
+    size_t frameID{0};
+    std::string filename;
+    // decoded image (sampled by the pixel based estimators, painted and encoded)
+    std::shared_ptr<ImgConverter> image;
+    // time the decoding started (frame budget of the live deadline)
+    std::chrono::steady_clock::time_point startTime;
+    // points with their cluster labels, clusters and their track IDs
+    std::vector<Vec2> points;
+    std::vector<uint8_t> labels;
+    ClusterList clusters;
+    std::vector<size_t> trackIds;
+};
+
 int main() {
     std::cout << "==================================" << std::endl;
     std::cout << "==== WIND TURBINE SPEEDOMETER ====" << std::endl;
@@ -51,6 +73,10 @@ int main() {
     std::string csvFileName = "../imgOut/AngularVelocity.csv";
     // fps
     double fps = 30;
+    // number of rotor blades (clusters seeded for the mixture model and k-means engines, the rotor model assumes three)
+    size_t numBlades = 3;
+    // angle between two rotor blades
+    double bladeSpacing = 4.0 * PI0_5 / RotorModel::numBlades;
     // region of interest for analysis
     ImgConverter::ROI roi;
     roi.maxCol = 500;
@@ -63,11 +89,65 @@ int main() {
     double varianceThreshold{1500.0};
     // scale of image points (pixel coordinates will be scaled down to avoid numerical issues in clustering algorithm)
     double scale = 50;//300.0;
+    // convergence policy of the cluster fitting
+    FitOptions fitOptions;
+    fitOptions.likelihoodTolerance = 1e-6;
+    fitOptions.maxIterations = 9;
+    fitOptions.angleTolerance = 0.0;
+    // threads used for the cluster fitting within a single frame
+    // (only worthwhile for live processing where few frames are in flight at once)
+    fitOptions.numThreads = 1;
+    // skip clusters further than this Mahalanobis distance from a coarse grid cell of points (0: evaluate all clusters)
+    fitOptions.truncationDistance = 5.0;
+    fitOptions.gridCellSize = 0.5;
+    // coarse-to-fine fitting: run early iterations on every pyramidFactor^level-th point (1: full resolution only)
+    fitOptions.pyramidLevels = 1;
+    fitOptions.pyramidFactor = 4;
+    fitOptions.fineIterations = 2;
+    // speculative restarts: fit this many rotated seeds concurrently and keep the best log likelihood,
+    // runs trailing by more than the margin (per point) are cancelled early (1: single fit)
+    fitOptions.restarts = 1;
+    fitOptions.restartCancelMargin = 0.05;
+    // seed the clusters of each frame with the previous frame's clusters rotated by the current rotation estimate
+    // (effective for sequential or pipelined processing where the previous frame has been fitted already)
+    bool warmStart = false;
+    // live processing: stop the cluster fitting of each frame when the frame interval (1/fps) minus the time
+    // spent decoding the image and extracting the points has passed, the fit so far is flagged as partial
+    bool liveDeadline = false;
+    // clustering algorithm: Gaussian mixture model (soft assignments), k-means (hard assignments, faster)
+    // or rotation-constrained rotor model (estimates a single rotor angle instead of one angle per blade)
+    // or polar histogram (rotor angle from the angle histogram around the hub, no EM - fastest)
+    // or mean shift (density modes, number of clusters found automatically)
+    // or connected components (separated blades in a single pass, mixture model fallback)
+    // or angular correlation (rotation between consecutive frames from their angular profiles, no clusters)
+    ClusterEngine clusterEngine = ClusterEngine::GaussianMixture;
+    // number of consecutive frames jointly fitted by a rotor rotating at constant angular velocity
+    // (replaces the per-frame angle differences by the fitted angular velocity, 0 disables the window fit)
+    size_t windowSize = 0;
+    // number of frames of the spectrum of the pixel intensities on rings around the hub, reported per window
+    // (needs about two blade passes per window, 0 disables the spectral estimation)
+    size_t spectrumWindow = 0;
+    // ring radii relative to the mean distance of the blade centers from the hub and pixels per ring
+    std::vector<double> ringRadii {0.5, 1.0, 1.5};
+    size_t samplesPerRing = 64;
+    // measure the rotation between consecutive frames by sparse optical flow of blade edge pixels
+    // (replaces the blade angle differences, no wrap-around of the angles)
+    bool opticalFlow = false;
+    // maximum number of workers running a stage of the frame pipeline at once (all stages share the maxThreads
+    // workers of the processor, matching and tracking run on a single worker at a time) and maximum number of
+    // frames in flight (constant memory)
+    size_t decodeThreads = maxThreads;
+    size_t extractThreads = maxThreads;
+    size_t clusterThreads = maxThreads;
+    size_t renderThreads = 1;
+    size_t encodeThreads = maxThreads;
+    size_t maxFramesInFlight = 4 * maxThreads;
 
     // cluster colors
     std::vector<uint8_t> col1  = {255,0,0};
     std::vector<uint8_t> col2  = {0,255,0};
     std::vector<uint8_t> col3  = {0,0,255};
+    std::vector<uint8_t> col4  = {255,255,0};
     std::vector<uint8_t> black = {0,0,0};
     
     // COLLECTING IMAGE FILES IN FOLDER
@@ -86,125 +166,298 @@ int main() {
     // ======================================
     // initialize image queue
     std::cout << "Analyzing " << files.size() << " images..." << std::endl;
-    std::shared_ptr<ParallelImageProcessor<size_t>> pip(new ParallelImageProcessor<size_t>(roi, rgbThreshold, varianceThreshold, scale, maxThreads));
-    std::vector<std::future<size_t>> futures;
+    std::shared_ptr<ParallelImageProcessor<size_t>> pip(new ParallelImageProcessor<size_t>(roi, rgbThreshold, varianceThreshold, scale, maxThreads, fitOptions, warmStart, clusterEngine,
+        liveDeadline ? 1.0 / fps : 0.0, numBlades));
     // sort the vector of files to assure correct processing order
     std::sort(files.begin(),files.end(),[](std::string a, std::string b){return a < b;}); 
     // start time measurement
     std::chrono::system_clock::time_point startTime = std::chrono::system_clock::now();
-    // process all files
-    for (size_t i = 0; i < files.size(); ++i) {
-        std::string file = files[i];
-        futures.emplace_back(std::async(&ParallelImageProcessor<size_t>::processImage, pip, std::move(i), file)); //std::launch::async
-        std::cout << files.at(i) << " (frameID : " << i << ") is being processed." << std::endl;
-        pip->readyForNextImage();
-    }
 
     // PROCESS FRAMES SEQUENTIALLY FOR SPEED ESTIMATION
     // ================================================
-    size_t frameID = 0;
-    // vector of estimated angular velocities (0 for first frame) [rad/s]
-    std::vector<double> avgAngVels{0.0}; 
-    std::vector<double> medAngVels{0.0}; 
-    std::vector<std::vector<double>> indivAngVels{{0.0,0.0,0.0}}; 
-    // maps clusters to color
-    std::map<std::shared_ptr<Cluster>,std::vector<uint8_t>> colMap; 
-    // sequentially estimate angular velocity from concurrent images 
-    while(futures.size()>0) {
-        auto &ftr = futures.front();
-        ftr.wait();
-        frameID = ftr.get();
-        futures.erase (futures.begin());
-        std::cout << files.at(frameID) << " (frameID : " << frameID << ") finished." << std::endl;
+    // results are written to the CSV file frame by frame
+    std::cout << "Writing to CSV: " << csvFileName << std::endl;
+    std::ofstream output_stream(csvFileName, std::ios::binary);
+    if (!output_stream.is_open()) {
+        std::cerr << "failed to open file: " << csvFileName << std::endl;
+        return EXIT_FAILURE;
+    }
+   
+    // write CSV header row
+    output_stream << "ID" << "," << "filename" 
+                          << "," << "Avg Ang Vel [rad/s]"
+                          << "," << "Med Ang Vel [rad/s]";
+    for (size_t i = 0; i < numBlades; ++i) {
+        output_stream << "," << "Ang Vel " << i + 1 << " [rad/s]";
+    }
+    output_stream << "," << "EM Iterations"
+                          << "," << "Log Likelihood"
+                          << "," << "Converged"
+                          << "," << "Fit Failed"
+                          << "," << "Filtered Ang Vel [rad/s]"
+                          << "," << "Filtered Ang Vel Std [rad/s]" <<std::endl;
+    
+    // estimated angular velocities of the latest frame (0 for first frame) [rad/s]
+    double avgAngVel = 0.0;
+    double medAngVel = 0.0;
+    std::vector<double> indivAngVel(numBlades, 0.0);
+    // statistics of the cluster fitting
+    size_t numFrames = 0;
+    size_t totalIterations = 0;
+    size_t unconverged = 0;
+    size_t partial = 0;
+    size_t failed = 0;
+    // blade identity across frames, colors and per blade results are indexed by the track ID
+    BladeTracker tracker(numBlades);
+    std::vector<size_t> trackIds;
+    std::vector<std::vector<uint8_t>> colors = {col1, col2, col3, col4};
+    // filtered rotor state (angular velocity and its standard deviation per frame [rad/s])
+    RotorTracker rotorTracker;
+    std::vector<double> bladeAngles;
+    std::vector<bool> bladeContinued;
+    // accumulated rotation of engines measuring rotations only
+    double measuredAngle = 0.0;
+    // joint fit of the latest frames
+    RotorWindowFit windowFit(windowSize, fitOptions);
+    // spectrum of the pixel intensities around the hub (set up on the first frame)
+    std::unique_ptr<RingSpectrum> ringSpectrum;
+    // optical flow tracker (set up on the first frame)
+    std::unique_ptr<OpticalFlow> flow;
+    // frame pipeline: decode -> extract -> cluster -> match -> render -> encode
+    Pipeline<FrameJob> pipeline(pip->getThreadPool(), maxFramesInFlight);
+    pipeline.addStage([](FrameJob &job) {
+        job.startTime = std::chrono::steady_clock::now();
+        job.image = std::make_shared<ImgConverter>();
+        job.image->load(job.filename);
+    }, decodeThreads);
+    pipeline.addStage([&pip](FrameJob &job) {
+        pip->extractPoints(*job.image, job.points);
+    }, extractThreads);
+    // frames are started in order (the warm start seeds a frame with the clusters of the previous frame if it
+    // has been fitted by then, which is only guaranteed for a single cluster thread)
+    pipeline.addStage([&pip](FrameJob &job) {
+        pip->processPoints(job.frameID, std::move(job.points), job.startTime, job.image.get());
+    }, clusterThreads, true);
+    // sequentially estimate angular velocity from concurrent images
+    pipeline.addStage([&](FrameJob &job) {
+        size_t frameID = job.frameID;
+        FitReport report = pip->getFitReport(frameID);
+        ++numFrames;
+        totalIterations += report.iterations;
+        bool fitFailed = report.choleskyFailed || report.emptyCluster;
+        unconverged += (report.converged || report.partial || fitFailed) ? 0 : 1;
+        partial += report.partial ? 1 : 0;
+        failed += fitFailed ? 1 : 0;
+        std::cout << files.at(frameID) << " (frameID : " << frameID << ") finished after " 
+                  << report.iterations << " EM iterations." << std::endl;
+        if (fitFailed) {
+            std::cout << "Cluster fitting of frame " << frameID << " failed." << std::endl;
+        }
 
         // match clusters of current and previous frame
-        std::vector<std::shared_ptr<Cluster>> cListCur;
+        ClusterList &cListCur = job.clusters;
         pip->getClusters(frameID, cListCur);
-        if (frameID == 0) {
-            // color mapping  rgbThreshold {200,200,255}
-            colMap.insert(std::make_pair(cListCur[0], col1));
-            colMap.insert(std::make_pair(cListCur[1], col2));
-            colMap.insert(std::make_pair(cListCur[2], col3));
-        } else {
-            std::vector<std::shared_ptr<Cluster>> cListPrev;
-            pip->getClusters(frameID-1, cListPrev);
+        std::vector<Vec2> &framePoints = job.points;
+        std::vector<uint8_t> &frameLabels = job.labels;
+        pip->getPoints(frameID, framePoints, frameLabels);
+        if (windowSize > 0 && !cListCur.empty()) {
+            std::vector<Vec2> clusterPoints;
+            for (size_t iPnt = 0; iPnt < framePoints.size(); ++iPnt) {
+                if (frameLabels[iPnt] < cListCur.size()) {
+                    clusterPoints.push_back(framePoints[iPnt]);
+                }
+            }
+            windowFit.addFrame(std::move(clusterPoints));
+        }
+        // decoded image (sampled by the pixel based estimators before painting the clusters)
+        ImgConverter &imgConv = *job.image;
 
-            std::map<std::shared_ptr<Cluster>,std::shared_ptr<Cluster>> cmap;
-            Cluster::matchClusters(cListPrev,cListCur,cmap);
-            double avgAngVel = 0.0;
-            std::vector<double> indivAngVel;
-            for (auto &match : cmap) {
-                auto cPrev = match.first;
-                auto cCur = match.second;
+        // sample the rings around the hub
+        if (spectrumWindow > 0 && !ringSpectrum && !cListCur.empty()) {
+            Vec2 hub = Cluster::getHub(cListCur);
+            double bladeRadius = 0.0;
+            for (auto &cluster : cListCur) {
+                bladeRadius += (cluster.center - hub).norm() / cListCur.size();
+            }
+            std::vector<double> radii;
+            for (double radius : ringRadii) {
+                radii.push_back(radius * bladeRadius * scale);
+            }
+            ringSpectrum.reset(new RingSpectrum(hub * scale, radii, samplesPerRing, spectrumWindow));
+        }
+        if (ringSpectrum) {
+            ringSpectrum->addFrame(imgConv);
+            if (ringSpectrum->size() % spectrumWindow == 0) {
+                std::cout << "Dominant blade passing frequency of frames " << frameID + 1 - spectrumWindow << " - " << frameID << ": "
+                          << ringSpectrum->getDominantFrequency() * fps << " Hz (angular velocity "
+                          << ringSpectrum->getAngularVelocity() * fps << " rad/s)" << std::endl;
+            }
+        }
 
+        // sparse optical flow from the previous frame (features selected on the blade pixels)
+        double flowRotation = NAN;
+        if (opticalFlow && !cListCur.empty()) {
+            if (!flow) {
+                flow.reset(new OpticalFlow(roi, Cluster::getHub(cListCur) * scale));
+            }
+            // the blade pixels are only needed when the tracked features are replenished
+            std::vector<Vec2> candidates;
+            for (size_t iPnt = 0; flow->needsFeatures() && iPnt < framePoints.size(); ++iPnt) {
+                if (frameLabels[iPnt] < cListCur.size()) {
+                    candidates.push_back(framePoints[iPnt] * scale);
+                }
+            }
+            flowRotation = flow->addFrame(imgConv, candidates);
+        }
+        // continue the blade tracks of the previous frame (new tracks in the first frame),
+        // the tracks are moved by the predicted rotation of the rotor state before matching
+        tracker.update(cListCur, trackIds, rotorTracker.getAngularVelocity());
+        if (frameID > 0) {
+            avgAngVel = 0.0;
+            std::vector<double> trackAngVel;
+            indivAngVel.assign(tracker.getMaxTracks(), NAN);
+            for (size_t id = 0; id < tracker.getMaxTracks(); ++id) {
+                if (!tracker.isContinued(id))
+                    continue;
                 // get cluster angles and account for angle ranges
-                double angPrev = cPrev->getAngle();
-                double angCur = cCur->getAngle();
+                double angPrev = tracker.getPreviousAngle(id);
+                double angCur = tracker.getAngle(id);
                 angCur = (angCur < 0 && angPrev > 0) ? angCur+PI0_5 : angCur;
                 double angVel = (angCur-angPrev)*fps;
-                indivAngVel.push_back(angVel);
+                indivAngVel[id] = angVel;
+                trackAngVel.push_back(angVel);
                 avgAngVel += angVel;
-                // match colors to previous cluster color
-                colMap.insert(std::make_pair(cCur, colMap.find(cPrev)->second));
-                colMap.erase(cPrev);
-            }
-            // mean angles
-            avgAngVel /= cmap.size();
-            avgAngVels.push_back(avgAngVel);
-            // median angles
-            std::nth_element(indivAngVel.begin(), indivAngVel.begin() + indivAngVel.size()/2, indivAngVel.end());
-            medAngVels.push_back(indivAngVel[indivAngVel.size()/2]);
-            //individual angles
-            indivAngVels.push_back(indivAngVel);
+            }
+            medAngVel = 0.0;
+            if (!trackAngVel.empty()) {
+                // mean angles
+                avgAngVel /= trackAngVel.size();
+                // median angles
+                std::nth_element(trackAngVel.begin(), trackAngVel.begin() + trackAngVel.size()/2, trackAngVel.end());
+                medAngVel = trackAngVel[trackAngVel.size()/2];
+            }
+            // engines estimating the rotor angle directly replace mean and median of the blade angles
+            double rotorAngleCur = pip->getRotorAngle(frameID);
+            double rotorAnglePrev = pip->getRotorAngle(frameID-1);
+            if (!std::isnan(rotorAngleCur) && !std::isnan(rotorAnglePrev)) {
+                // rotor angles are defined modulo the blade spacing
+                double rotation = rotorAngleCur - rotorAnglePrev;
+                rotation -= bladeSpacing * std::round(rotation / bladeSpacing);
+                avgAngVel = rotation * fps;
+                medAngVel = avgAngVel;
+            }
+            // engines measuring the rotation between frames directly replace mean and median of the blade angles
+            double rotation = pip->getRotation(frameID-1, frameID);
+            if (!std::isnan(rotation)) {
+                avgAngVel = rotation * fps;
+                medAngVel = avgAngVel;
+            }
+            // the optical flow measures the rotation directly
+            if (!std::isnan(flowRotation)) {
+                avgAngVel = flowRotation * fps;
+                medAngVel = avgAngVel;
+            }
+            // the window fit estimates the angular velocity directly
+            if (windowSize > 0 && windowFit.size() > 1) {
+                avgAngVel = windowFit.getAngularVelocity() * fps;
+                medAngVel = avgAngVel;
+            }
+            // blades without continued track (or engines without clusters) report the rotor's angular velocity
+            for (auto &angVel : indivAngVel) {
+                angVel = std::isnan(angVel) ? avgAngVel : angVel;
+            }
         }
-        // color clusters in image and save to output folder
-        const char* fn = files[frameID].c_str();
-        ImgConverter imgConv;
-        imgConv.load(fn);
-
-        for (auto &cluster : cListCur) {
-            if (cluster->cPoints->size() > 0) {
-                std::shared_ptr<ImgConverter::PointList> pointsImg = std::make_shared<ImgConverter::PointList>();
-                for(auto pnt = cluster->cPoints->begin(); pnt != cluster->cPoints->end(); ++pnt) {
-                    pointsImg->push_back({static_cast<size_t>(pnt->front()*scale),static_cast<size_t>(pnt->back()*scale)});
-                }
-                imgConv.writePointsToImg (pointsImg,colMap.find(cluster)->second);
+
+        // filter the rotor state by the rotor angle of engines estimating it directly, else by the blade angles
+        // of the tracks, else by the accumulated rotation (angles are defined modulo the returned period)
+        double rotorAngle = pip->getRotorAngle(frameID);
+        double period = bladeSpacing;
+        bladeAngles.clear();
+        bladeContinued.clear();
+        if (!std::isnan(rotorAngle)) {
+            bladeAngles.push_back(rotorAngle);
+            bladeContinued.push_back(frameID > 0);
+        } else if (!cListCur.empty()) {
+            // the cluster axes are defined modulo pi/2 and the blades are 2 pi/numBlades apart, thus all blades
+            // measure the rotor angle modulo 2 pi/lcm(numBlades, 4), pi/6 for three blades (independent of their identity)
+            period = 4.0 * PI0_5 / std::lcm<size_t>(numBlades, 4);
+            for (size_t id = 0; id < tracker.getMaxTracks(); ++id) {
+                bladeAngles.push_back(tracker.isActive(id) ? tracker.getAngle(id) : NAN);
+                bladeContinued.push_back(tracker.isContinued(id));
             }
+        } else {
+            period = 4.0 * PI0_5;
+            measuredAngle += avgAngVel / fps;
+            bladeAngles.push_back(measuredAngle);
+            bladeContinued.push_back(frameID > 0);
+        }
+        rotorTracker.update(bladeAngles, bladeContinued, period);
+        // seed the clusters of the frames still to be fitted with the predicted rotation
+        if (warmStart) {
+            pip->setRotationPrediction(rotorTracker.getAngularVelocity());
+        }
+        job.trackIds = trackIds;
+        // the frame's results are not needed anymore once the next frame has been matched
+        if (frameID > 0) {
+            pip->releaseFramesBefore(frameID - 1);
         }
-        imgConv.save("../imgOut/out" + std::to_string(frameID) + ".png");
-    }
 
-    // WRITE RESULTS TO CSV FILE
-    // ======================================
-    std::cout << "Writing to CSV: " << csvFileName << std::endl;
-    std::ofstream output_stream(csvFileName, std::ios::binary);
-    if (!output_stream.is_open()) {
-        std::cerr << "failed to open file: " << csvFileName << std::endl;
-        return EXIT_FAILURE;
-    }
-   
-    // write CSV header row
-    output_stream << "ID" << "," << "filename" 
-                          << "," << "Avg Ang Vel [rad/s]"
-                          << "," << "Med Ang Vel [rad/s]"
-                          << "," << "Ang Vel 1 [rad/s]" 
-                          << "," << "Ang Vel 2 [rad/s]" 
-                          << "," << "Ang Vel 3 [rad/s]" <<std::endl;
-    
-    // write det/des performance data to .csv output file line by line
-    for (int i = 0; i < files.size(); ++i) {
-
-    output_stream << i
-                    << "," << files.at(i)
-                    << "," << avgAngVels.at(i)
-                    << "," << medAngVels.at(i)
-                    << "," << indivAngVels.at(i).at(0)
-                    << "," << indivAngVels.at(i).at(1)
-                    << "," << indivAngVels.at(i).at(2)
-                    << std::endl;
-    }
+        // write the results of the frame to the CSV file
+        output_stream << frameID
+                        << "," << files.at(frameID)
+                        << "," << avgAngVel
+                        << "," << medAngVel;
+        for (size_t i = 0; i < numBlades; ++i) {
+            output_stream << "," << indivAngVel.at(i);
+        }
+        output_stream << "," << report.iterations
+                        << "," << report.logLikelihood
+                        << "," << report.converged
+                        << "," << (report.choleskyFailed || report.emptyCluster)
+                        << "," << rotorTracker.getAngularVelocity() * fps
+                        << "," << rotorTracker.getAngularVelocityStd() * fps
+                        << std::endl;
+    }, 1, true);
+    // color clusters in image and save to output folder
+    pipeline.addStage([&](FrameJob &job) {
+        std::vector<std::shared_ptr<ImgConverter::PointList>> pointsImg(job.clusters.size());
+        for (auto &clusterPoints : pointsImg) {
+            clusterPoints = std::make_shared<ImgConverter::PointList>();
+        }
+        for (size_t iPnt = 0; iPnt < job.points.size(); ++iPnt) {
+            if (job.labels[iPnt] < job.clusters.size()) {
+                auto &pnt = job.points[iPnt];
+                pointsImg[job.labels[iPnt]]->push_back({static_cast<size_t>(pnt[0]*scale),static_cast<size_t>(pnt[1]*scale)});
+            }
+        }
+        for (size_t i = 0; i < job.clusters.size(); ++i) {
+            if (pointsImg[i]->size() > 0) {
+                job.image->writePointsToImg (pointsImg[i], job.trackIds[i] < colors.size() ? colors[job.trackIds[i]] : black);
+            }
+        }
+    }, renderThreads);
+    pipeline.addStage([](FrameJob &job) {
+        job.image->save("../imgOut/out" + std::to_string(job.frameID) + ".png");
+    }, encodeThreads);
+    size_t nextFile = 0;
+    pipeline.run([&files, &nextFile](FrameJob &job) {
+        if (nextFile == files.size())
+            return false;
+        job.frameID = nextFile;
+        job.filename = files[nextFile];
+        std::cout << files.at(nextFile) << " (frameID : " << nextFile << ") is being processed." << std::endl;
+        ++nextFile;
+        return true;
+    });
+
     output_stream.close();
 
+    // print fitting statistics
+    std::cout << "Average number of EM iterations: " << (numFrames > 0 ? static_cast<double>(totalIterations) / numFrames : 0.0)
+              << " (" << unconverged << " frames used the full iteration budget, "
+              << partial << " frames stopped at the deadline, "
+              << failed << " fits failed)" << std::endl;
+
     // print timing results
     std::chrono::system_clock::time_point endTime = std::chrono::system_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>( endTime - startTime ).count();
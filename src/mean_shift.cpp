@@ -0,0 +1,164 @@
+#ifndef MEAN_SHIFT_CPP_
+#define MEAN_SHIFT_CPP_
+#include <algorithm>
+#include <math.h>
+
+#include "mean_shift.h"
+
+MeanShiftModel::MeanShiftModel(std::vector<Vec2> pointsIn, double bandwidth, size_t maxIterations, double minClusterFraction) :
+    points(std::move(pointsIn)), _bandwidth(bandwidth), _maxIterations(maxIterations), _minClusterFraction(minClusterFraction) {}
+
+long long MeanShiftModel::cellKey(long row, long col) const
+{
+    return (static_cast<long long>(row) << 32) ^ static_cast<long long>(static_cast<unsigned int>(col));
+}
+
+void MeanShiftModel::buildGrid()
+{
+    std::vector<std::pair<long long, size_t>> keyed(points.size());
+    for (size_t i = 0; i < points.size(); ++i) {
+        keyed[i] = std::make_pair(cellKey(std::floor(points[i][0] / _bandwidth), std::floor(points[i][1] / _bandwidth)), i);
+    }
+    std::sort(keyed.begin(), keyed.end());
+    _cellPoints.resize(points.size());
+    _cells.clear();
+    _cellRanges.clear();
+    for (size_t i = 0; i < keyed.size(); ++i) {
+        _cellPoints[i] = keyed[i].second;
+        if (i == 0 || keyed[i].first != keyed[i - 1].first) {
+            _cellRanges.emplace_back(i, i);
+        }
+        _cellRanges.back().second = i + 1;
+        _cells[keyed[i].first] = _cellRanges.back();
+    }
+}
+
+bool MeanShiftModel::neighbourhoodMean(const Vec2 &pos, Vec2 &mean) const
+{
+    long row = std::floor(pos[0] / _bandwidth);
+    long col = std::floor(pos[1] / _bandwidth);
+    Vec2 sum = Vec2::zero();
+    size_t count = 0;
+    for (long dr = -1; dr <= 1; ++dr) {
+        for (long dc = -1; dc <= 1; ++dc) {
+            auto cell = _cells.find(cellKey(row + dr, col + dc));
+            if (cell == _cells.end())
+                continue;
+            for (size_t i = cell->second.first; i < cell->second.second; ++i) {
+                const Vec2 &pnt = points[_cellPoints[i]];
+                if ((pnt - pos).squaredNorm() <= _bandwidth * _bandwidth) {
+                    sum += pnt;
+                    ++count;
+                }
+            }
+        }
+    }
+    if (count == 0)
+        return false;
+    mean = sum * (1.0 / count);
+    return true;
+}
+
+FitReport MeanShiftModel::runClusterFitting()
+{
+    FitReport report;
+    report.converged = true;
+    buildGrid();
+
+    // shift the seeds (centroids of the occupied cells, in the order of the cells) to their modes
+    std::vector<Vec2> peaks;
+    for (auto &range : _cellRanges) {
+        Vec2 seed = Vec2::zero();
+        for (size_t i = range.first; i < range.second; ++i) {
+            seed += points[_cellPoints[i]];
+        }
+        seed = seed * (1.0 / (range.second - range.first));
+        bool converged = false;
+        size_t i = 0;
+        while (i < _maxIterations && !converged) {
+            Vec2 mean;
+            if (!neighbourhoodMean(seed, mean))
+                break;
+            converged = (mean - seed).squaredNorm() < 1e-6 * _bandwidth * _bandwidth;
+            seed = mean;
+            ++i;
+        }
+        report.converged = report.converged && converged;
+        report.iterations = std::max(report.iterations, i);
+        peaks.push_back(seed);
+    }
+
+    // merge peaks closer than the bandwidth into modes
+    std::vector<Vec2> candidates;
+    std::vector<size_t> support;
+    for (auto &peak : peaks) {
+        bool merged = false;
+        for (size_t m = 0; m < candidates.size() && !merged; ++m) {
+            if ((candidates[m] - peak).squaredNorm() < _bandwidth * _bandwidth) {
+                // running mean of the merged peaks
+                candidates[m] = candidates[m] + (peak - candidates[m]) * (1.0 / (support[m] + 1));
+                ++support[m];
+                merged = true;
+            }
+        }
+        if (!merged) {
+            candidates.push_back(peak);
+            support.push_back(1);
+        }
+    }
+
+    // assign each point to its closest mode, drop modes with too few points (and beyond maxClusters)
+    std::vector<size_t> closest(points.size());
+    std::vector<size_t> counts(candidates.size(), 0);
+    for (size_t i = 0; i < points.size(); ++i) {
+        double minDist = INFINITY;
+        for (size_t m = 0; m < candidates.size(); ++m) {
+            double dist = (points[i] - candidates[m]).squaredNorm();
+            if (dist < minDist) {
+                minDist = dist;
+                closest[i] = m;
+            }
+        }
+        ++counts[closest[i]];
+    }
+    std::vector<uint8_t> clusterIndex(candidates.size(), noCluster);
+    modes.clear();
+    for (size_t m = 0; m < candidates.size(); ++m) {
+        if (counts[m] >= _minClusterFraction * points.size() && modes.size() < maxClusters) {
+            clusterIndex[m] = static_cast<uint8_t>(modes.size());
+            modes.push_back(candidates[m]);
+        }
+    }
+    labels.resize(points.size());
+    for (size_t i = 0; i < points.size(); ++i) {
+        labels[i] = clusterIndex[closest[i]];
+    }
+    report.emptyCluster = modes.empty();
+    return report;
+}
+
+void MeanShiftModel::getClusters(ClusterList &clusters) const
+{
+    // moments of the points of each cluster
+    std::vector<double> counts(modes.size(), 0.0);
+    std::vector<Vec2> first(modes.size(), Vec2::zero());
+    std::vector<Mat2> second(modes.size(), Mat2::zero());
+    double total = 0.0;
+    for (size_t i = 0; i < points.size(); ++i) {
+        if (labels[i] == noCluster)
+            continue;
+        Vec2 dist = points[i] - modes[labels[i]];
+        counts[labels[i]] += 1.0;
+        first[labels[i]] += dist;
+        second[labels[i]] += Mat2::outer(dist, dist);
+        total += 1.0;
+    }
+    clusters.clear();
+    for (size_t m = 0; m < modes.size(); ++m) {
+        Vec2 mean = first[m] * (1.0 / counts[m]);
+        Mat2 sigma = second[m] * (1.0 / counts[m]) - Mat2::outer(mean, mean);
+        clusters.emplace_back(modes[m] + mean, sigma, counts[m] / total);
+    }
+}
+
+#endif /* MEAN_SHIFT_CPP_ */
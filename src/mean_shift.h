@@ -0,0 +1,54 @@
+#ifndef MEAN_SHIFT_H_
+#define MEAN_SHIFT_H_
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include "clustering.h"
+
+// Density based clustering by mean shift with a flat kernel. The points are hashed into a uniform grid with the
+// bandwidth as cell size, so each neighbourhood query visits the 3x3 cells around the query only. Seeds are the
+// centroids of the occupied grid cells, each seed is shifted to the mean of its neighbourhood until it converges
+// to a density mode. Modes closer than the bandwidth are merged, every point belongs to its closest mode and modes
+// with too few points are dropped as noise. The number of clusters follows from the data, no seeding is needed.
+class MeanShiftModel
+{
+public:
+    // label of points which belong to no cluster
+    static constexpr uint8_t noCluster = noLabel;
+
+    // vector of points which are to be clustered
+    std::vector<Vec2> points;
+    // cluster index of each point (noCluster for noise) after fitting
+    std::vector<uint8_t> labels;
+    // density modes of the clusters after fitting
+    std::vector<Vec2> modes;
+
+    // Constructor (bandwidth in the units of the points)
+    MeanShiftModel(std::vector<Vec2> points, double bandwidth = 1.2, std::size_t maxIterations = 50, double minClusterFraction = 0.05);
+
+    // shifts the seeds to the density modes and assigns the points
+    FitReport runClusterFitting();
+    // returns the clusters (mean and covariance of their points, labels are the cluster indices)
+    void getClusters(ClusterList &clusters) const;
+
+private:
+    double _bandwidth;
+    std::size_t _maxIterations;
+    double _minClusterFraction;
+    // point indices sorted by grid cell and the range of each occupied cell
+    std::vector<std::size_t> _cellPoints;
+    std::unordered_map<long long, std::pair<std::size_t, std::size_t>> _cells;
+    // ranges of the occupied cells in the order of their keys (seeds and modes do not depend on the hash order)
+    std::vector<std::pair<std::size_t, std::size_t>> _cellRanges;
+
+    // key of the grid cell of a position
+    long long cellKey(long row, long col) const;
+    // hashes the points into the grid
+    void buildGrid();
+    // mean of the points within the bandwidth around the position (returns false if there are none)
+    bool neighbourhoodMean(const Vec2 &pos, Vec2 &mean) const;
+};
+
+#endif // MEAN_SHIFT_H_
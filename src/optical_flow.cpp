@@ -0,0 +1,283 @@
+#ifndef OPTICAL_FLOW_CPP_
+#define OPTICAL_FLOW_CPP_
+#include <algorithm>
+#include <math.h>
+
+#include "optical_flow.h"
+
+// half size of the Lucas-Kanade window (pixels)
+static const long windowRadius = 5;
+// pixels of the Lucas-Kanade window
+static const std::size_t windowPixels = (2 * windowRadius + 1) * (2 * windowRadius + 1);
+// pixels of a level the window may move before the patch of the current frame is extracted again
+static const long searchMargin = 2;
+// Gauss-Newton iterations per pyramid level
+static const std::size_t maxTrackIterations = 10;
+// grid cell size of the feature selection (pixels)
+static const long featureCellSize = 8;
+// features closer to the hub hardly move and are ignored (pixels)
+static const double minFeatureRadius = 10.0;
+// minimum number of tracked features for a rotation estimate
+static const std::size_t minFeatures = 8;
+// candidates scored per feature when the features are reselected
+static const std::size_t candidatesPerFeature = 8;
+
+float OpticalFlow::Image::at(long row, long col) const
+{
+    row = std::min(std::max(row, 0L), rows - 1);
+    col = std::min(std::max(col, 0L), cols - 1);
+    return data[row * cols + col];
+}
+
+float OpticalFlow::Image::sample(double row, double col) const
+{
+    row -= row0;
+    col -= col0;
+    long r = static_cast<long>(std::floor(row));
+    long c = static_cast<long>(std::floor(col));
+    float fr = static_cast<float>(row - r);
+    float fc = static_cast<float>(col - c);
+    return (1 - fr) * ((1 - fc) * at(r, c) + fc * at(r, c + 1)) + fr * ((1 - fc) * at(r + 1, c) + fc * at(r + 1, c + 1));
+}
+
+OpticalFlow::OpticalFlow(const ImgConverter::ROI &roi, const Vec2 &hub, size_t maxFeatures, size_t numLevels) :
+    _roi(roi), _rows(roi.maxRow - roi.minRow), _cols(roi.maxCol - roi.minCol), _maxFeatures(maxFeatures),
+    _numLevels(std::max<size_t>(numLevels, 1))
+{
+    _hub = hub - Vec2{static_cast<double>(roi.minRow), static_cast<double>(roi.minCol)};
+    _cellScores.assign((_rows / featureCellSize + 1) * (_cols / featureCellSize + 1), -1.0);
+    _cellFeatures.resize(_cellScores.size());
+}
+
+void OpticalFlow::extractPatch(const ImgConverter &img, size_t level, long row0, long col0, long size, Image &patch) const
+{
+    patch.row0 = row0;
+    patch.col0 = col0;
+    patch.rows = size;
+    patch.cols = size;
+    patch.data.resize(size * size);
+    const long block = 1L << level;
+    const float norm = 1.0f / (block * block);
+    for (long row = 0; row < size; ++row) {
+        for (long col = 0; col < size; ++col) {
+            float sum = 0.0f;
+            for (long br = 0; br < block; ++br) {
+                long pixelRow = std::min(std::max((row0 + row) * block + br, 0L), _rows - 1);
+                for (long bc = 0; bc < block; ++bc) {
+                    long pixelCol = std::min(std::max((col0 + col) * block + bc, 0L), _cols - 1);
+                    sum += img.getIntensity(_roi.minRow + pixelRow, _roi.minCol + pixelCol);
+                }
+            }
+            patch.data[row * size + col] = sum * norm;
+        }
+    }
+}
+
+void OpticalFlow::selectFeatures(const ImgConverter &img, const std::vector<Vec2> &candidates)
+{
+    const long cellCols = _cols / featureCellSize + 1;
+    // strongest gradient per grid cell of a bounded subsample of the candidates
+    size_t stride = std::max<size_t>(1, candidates.size() / (candidatesPerFeature * std::max<size_t>(_maxFeatures, 1)));
+    for (size_t iCand = 0; iCand < candidates.size(); iCand += stride) {
+        long row = std::lround(candidates[iCand][0]) - static_cast<long>(_roi.minRow);
+        long col = std::lround(candidates[iCand][1]) - static_cast<long>(_roi.minCol);
+        if (row < windowRadius || col < windowRadius || row >= _rows - windowRadius || col >= _cols - windowRadius)
+            continue;
+        Vec2 feature{static_cast<double>(row), static_cast<double>(col)};
+        if ((feature - _hub).norm() < minFeatureRadius)
+            continue;
+        double gradRow = img.getIntensity(_roi.minRow + row + 1, _roi.minCol + col) - img.getIntensity(_roi.minRow + row - 1, _roi.minCol + col);
+        double gradCol = img.getIntensity(_roi.minRow + row, _roi.minCol + col + 1) - img.getIntensity(_roi.minRow + row, _roi.minCol + col - 1);
+        double score = gradRow * gradRow + gradCol * gradCol;
+        if (score <= 0.0)
+            continue;
+        size_t cell = (row / featureCellSize) * cellCols + col / featureCellSize;
+        if (_cellScores[cell] < score) {
+            if (_cellScores[cell] < 0.0)
+                _touchedCells.push_back(cell);
+            _cellScores[cell] = score;
+            _cellFeatures[cell] = feature;
+        }
+    }
+
+    // strongest cells, then reset the grid for the next selection
+    _features.clear();
+    size_t count = std::min(_maxFeatures, _touchedCells.size());
+    std::partial_sort(_touchedCells.begin(), _touchedCells.begin() + count, _touchedCells.end(),
+        [this](size_t a, size_t b) { return _cellScores[a] > _cellScores[b]; });
+    for (size_t i = 0; i < count; ++i) {
+        _features.push_back(_cellFeatures[_touchedCells[i]]);
+    }
+    for (auto cell : _touchedCells) {
+        _cellScores[cell] = -1.0;
+    }
+    _touchedCells.clear();
+}
+
+void OpticalFlow::buildTemplates(const ImgConverter &img)
+{
+    const size_t numTemplates = _features.size() * _numLevels;
+    _templateValues.resize(numTemplates * windowPixels);
+    _templateGradRows.resize(numTemplates * windowPixels);
+    _templateGradCols.resize(numTemplates * windowPixels);
+    _templateStructureInv.resize(numTemplates);
+    _templateValid.resize(numTemplates);
+    for (size_t i = 0; i < _features.size(); ++i) {
+        for (size_t level = 0; level < _numLevels; ++level) {
+            const size_t t = i * _numLevels + level;
+            Vec2 pnt = _features[i] * (1.0 / (1 << level));
+            // window plus one pixel for the gradients and one for the interpolation
+            extractPatch(img, level, static_cast<long>(std::floor(pnt[0])) - windowRadius - 1,
+                static_cast<long>(std::floor(pnt[1])) - windowRadius - 1, 2 * windowRadius + 4, _patch);
+
+            // structure tensor of the window (regularized for edges, where only the flow across the edge is observable)
+            Mat2 structure = Mat2::identity() * 1e-3;
+            size_t idx = t * windowPixels;
+            for (long dr = -windowRadius; dr <= windowRadius; ++dr) {
+                for (long dc = -windowRadius; dc <= windowRadius; ++dc, ++idx) {
+                    double row = pnt[0] + dr;
+                    double col = pnt[1] + dc;
+                    double gradRow = 0.5 * (_patch.sample(row + 1, col) - _patch.sample(row - 1, col));
+                    double gradCol = 0.5 * (_patch.sample(row, col + 1) - _patch.sample(row, col - 1));
+                    _templateValues[idx] = _patch.sample(row, col);
+                    _templateGradRows[idx] = gradRow;
+                    _templateGradCols[idx] = gradCol;
+                    structure += Mat2::outer(Vec2{gradRow, gradCol}, Vec2{gradRow, gradCol});
+                }
+            }
+            _templateValid[t] = structure.inverse(_templateStructureInv[t]);
+        }
+    }
+}
+
+bool OpticalFlow::track(const ImgConverter &img, size_t i, const Vec2 &guess, Vec2 &tracked)
+{
+    const Vec2 &feature = _features[i];
+    // patch of the current frame covering the window while it moves by up to the search margin
+    const long patchSize = 2 * (windowRadius + searchMargin) + 4;
+    // displacement guess at the coarsest level
+    Vec2 displacement = guess * (1.0 / (1 << (_numLevels - 1)));
+    for (size_t level = _numLevels; level-- > 0;) {
+        const size_t t = i * _numLevels + level;
+        if (!_templateValid[t])
+            return false;
+        const Mat2 &structureInv = _templateStructureInv[t];
+        Vec2 pnt = feature * (1.0 / (1 << level));
+
+        // Gauss-Newton iterations on the displacement
+        Vec2 patchCenter{NAN, NAN};
+        for (size_t iter = 0; iter < maxTrackIterations; ++iter) {
+            Vec2 center = pnt + displacement;
+            if (!std::isfinite(center[0]) || !std::isfinite(center[1]))
+                return false;
+            if (!(std::fabs(center[0] - patchCenter[0]) <= searchMargin && std::fabs(center[1] - patchCenter[1]) <= searchMargin)) {
+                extractPatch(img, level, static_cast<long>(std::floor(center[0])) - windowRadius - searchMargin - 1,
+                    static_cast<long>(std::floor(center[1])) - windowRadius - searchMargin - 1, patchSize, _patch);
+                patchCenter = center;
+            }
+            Vec2 mismatch = Vec2::zero();
+            size_t idx = t * windowPixels;
+            for (long dr = -windowRadius; dr <= windowRadius; ++dr) {
+                for (long dc = -windowRadius; dc <= windowRadius; ++dc, ++idx) {
+                    double diff = _templateValues[idx] - _patch.sample(center[0] + dr, center[1] + dc);
+                    mismatch += Vec2{_templateGradRows[idx], _templateGradCols[idx]} * diff;
+                }
+            }
+            Vec2 step = structureInv * mismatch;
+            displacement += step;
+            if (step.norm() < 0.01)
+                break;
+        }
+        if (level > 0) {
+            displacement = displacement * 2.0;
+        }
+    }
+    tracked = feature + displacement;
+    return tracked[0] >= 0 && tracked[1] >= 0 && tracked[0] < _rows && tracked[1] < _cols;
+}
+
+double OpticalFlow::fitRotation(const std::vector<Vec2> &from, const std::vector<Vec2> &to)
+{
+    // rotation of each feature about the hub (tangential flow over radius)
+    _rotations.clear();
+    for (size_t i = 0; i < from.size(); ++i) {
+        Vec2 arm = from[i] - _hub;
+        Vec2 flow = to[i] - from[i];
+        _rotations.push_back((arm[0] * flow[1] - arm[1] * flow[0]) / arm.squaredNorm());
+    }
+    // reject outliers wrt. median and median absolute deviation
+    _sorted = _rotations;
+    std::nth_element(_sorted.begin(), _sorted.begin() + _sorted.size() / 2, _sorted.end());
+    double median = _sorted[_sorted.size() / 2];
+    for (auto &value : _sorted) {
+        value = std::fabs(value - median);
+    }
+    std::nth_element(_sorted.begin(), _sorted.begin() + _sorted.size() / 2, _sorted.end());
+    double threshold = 3.0 * 1.4826 * _sorted[_sorted.size() / 2] + 1e-6;
+
+    // least squares rotation of the inliers
+    double sumCross = 0.0;
+    double sumSquares = 0.0;
+    _trackedFeatures = 0;
+    _inliers.assign(from.size(), 0);
+    for (size_t i = 0; i < from.size(); ++i) {
+        if (std::fabs(_rotations[i] - median) > threshold)
+            continue;
+        Vec2 arm = from[i] - _hub;
+        Vec2 flow = to[i] - from[i];
+        sumCross += arm[0] * flow[1] - arm[1] * flow[0];
+        sumSquares += arm.squaredNorm();
+        _inliers[i] = 1;
+        ++_trackedFeatures;
+    }
+    return sumCross / sumSquares;
+}
+
+double OpticalFlow::addFrame(const ImgConverter &img, const std::vector<Vec2> &candidates)
+{
+    // the features are reselected from the candidates of this frame if too many have been lost before
+    bool reselect = needsFeatures();
+    double rotation = NAN;
+    _trackedFeatures = 0;
+    _from.clear();
+    _to.clear();
+    if (_features.size() >= minFeatures) {
+        // track the features of the previous frame, guessing the rotation of the previous frame pair
+        double c = std::cos(_lastRotation);
+        double s = std::sin(_lastRotation);
+        for (size_t i = 0; i < _features.size(); ++i) {
+            Vec2 arm = _features[i] - _hub;
+            Vec2 guess = Vec2{c * arm[0] - s * arm[1], s * arm[0] + c * arm[1]} - arm;
+            Vec2 tracked;
+            if (track(img, i, guess, tracked)) {
+                _from.push_back(_features[i]);
+                _to.push_back(tracked);
+            }
+        }
+        if (_from.size() >= minFeatures) {
+            rotation = fitRotation(_from, _to);
+            _lastRotation = rotation;
+        }
+    }
+
+    if (reselect) {
+        selectFeatures(img, candidates);
+    } else {
+        // the tracked features (inliers of the rotation) are tracked on into the next frame
+        _features.clear();
+        for (size_t i = 0; i < _to.size(); ++i) {
+            const Vec2 &feature = _to[i];
+            if (!std::isnan(rotation) && !_inliers[i])
+                continue;
+            if (feature[0] < windowRadius || feature[1] < windowRadius || feature[0] >= _rows - windowRadius || feature[1] >= _cols - windowRadius)
+                continue;
+            if ((feature - _hub).norm() < minFeatureRadius)
+                continue;
+            _features.push_back(feature);
+        }
+    }
+    buildTemplates(img);
+    return rotation;
+}
+
+#endif /* OPTICAL_FLOW_CPP_ */
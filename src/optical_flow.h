@@ -0,0 +1,93 @@
+#ifndef OPTICAL_FLOW_H_
+#define OPTICAL_FLOW_H_
+
+#include <vector>
+
+#include "img_converter.h"
+#include "small_matrix.h"
+
+// Measures the rotation of the rotor between consecutive frames by sparse optical flow: a limited number of
+// high gradient blade pixels (edges of the blades) is tracked from the previous to the current frame by
+// pyramidal Lucas-Kanade, and a single rigid rotation about the hub is fitted to the flow vectors (robust
+// least squares on the tangential flow). The image is only sampled in small patches around the features at
+// each pyramid level (no pyramid of the whole region of interest), the features are tracked on from frame to
+// frame and only reselected from a bounded subsample of the candidates when too many have been lost, thus
+// the cost per frame scales with the number of tracked features, not with the foreground size.
+class OpticalFlow
+{
+public:
+    // Constructor (hub in pixel coordinates)
+    OpticalFlow(const ImgConverter::ROI &roi, const Vec2 &hub, std::size_t maxFeatures = 200, std::size_t numLevels = 3);
+
+    // returns true if the features are reselected from the candidates of the next frame
+    bool needsFeatures() const { return _features.size() < _maxFeatures / 2; }
+    // adds the next frame and returns the rotation in rad from the previous frame (NaN for the first frame or
+    // if too few features could be tracked). If needsFeatures, the features are reselected from the candidates
+    // (blade pixels of this frame in pixel coordinates), else the candidates are not used
+    double addFrame(const ImgConverter &img, const std::vector<Vec2> &candidates);
+    // returns the number of features used for the latest rotation
+    std::size_t getTrackedFeatures() const { return _trackedFeatures; }
+
+private:
+    // grayscale patch of one pyramid level (origin in the coordinates of the level)
+    struct Image
+    {
+        long row0{0};
+        long col0{0};
+        long rows{0};
+        long cols{0};
+        std::vector<float> data;
+        // pixel value, coordinates relative to the origin clamped to the patch
+        float at(long row, long col) const;
+        // bilinear interpolation (coordinates of the level)
+        float sample(double row, double col) const;
+    };
+
+    ImgConverter::ROI _roi;
+    // size of the region of interest
+    long _rows;
+    long _cols;
+    // hub relative to the region of interest
+    Vec2 _hub;
+    std::size_t _maxFeatures;
+    std::size_t _numLevels;
+    // features in the previous frame (relative to the region of interest)
+    std::vector<Vec2> _features;
+    // window of each feature and level in the previous frame: intensities and gradients of the window pixels
+    // (feature major, windowPixels per feature and level) and inverse structure tensor (invalid: not trackable)
+    std::vector<double> _templateValues;
+    std::vector<double> _templateGradRows;
+    std::vector<double> _templateGradCols;
+    std::vector<Mat2> _templateStructureInv;
+    std::vector<char> _templateValid;
+    std::size_t _trackedFeatures{0};
+    // rotation of the previous frame pair (initial guess of the flow)
+    double _lastRotation{0.0};
+
+    // scratch buffers reused by all frames
+    Image _patch;
+    std::vector<Vec2> _from;
+    std::vector<Vec2> _to;
+    std::vector<double> _rotations;
+    std::vector<double> _sorted;
+    std::vector<char> _inliers;
+    // strongest candidate per cell of the feature selection grid (flat, reset via the touched cells)
+    std::vector<double> _cellScores;
+    std::vector<Vec2> _cellFeatures;
+    std::vector<std::size_t> _touchedCells;
+
+    // copies the patch of the given level with the given origin and size from the image (level pixels are
+    // averages of 2^level x 2^level pixels, clamped to the region of interest)
+    void extractPatch(const ImgConverter &img, std::size_t level, long row0, long col0, long size, Image &patch) const;
+    // selects the features from a subsample of the candidates (strongest gradient per grid cell, the strongest
+    // cells up to the maximum number of features)
+    void selectFeatures(const ImgConverter &img, const std::vector<Vec2> &candidates);
+    // stores the windows of all features in the image for tracking them into the next frame
+    void buildTemplates(const ImgConverter &img);
+    // tracks feature i from the previous frame into the image starting at the guessed displacement
+    bool track(const ImgConverter &img, std::size_t i, const Vec2 &guess, Vec2 &tracked);
+    // fits a rotation about the hub to the flow of the features, marks the inliers
+    double fitRotation(const std::vector<Vec2> &from, const std::vector<Vec2> &to);
+};
+
+#endif // OPTICAL_FLOW_H_
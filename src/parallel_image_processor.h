@@ -1,124 +1,422 @@
 #ifndef PARALLELIMAGEPROCESSOR_H_
 #define PARALLELIMAGEPROCESSOR_H_
 
+#include <chrono>
+#include <cmath>
 #include <thread>
 #include <future>
+#include <limits>
+#include <map>
 #include <queue>
 #include <mutex>
 #include <string>
 #include <memory>
 
 #include "clustering.h"
+#include "connected_components.h"
+#include "frame_result.h"
 #include "img_converter.h"
+#include "kmeans_clustering.h"
+#include "mean_shift.h"
+#include "angular_correlation.h"
+#include "polar_histogram.h"
+#include "rotor_model.h"
+#include "thread_pool.h"
+
+// clustering algorithm used to fit the rotor blade clusters in each frame
+enum class ClusterEngine
+{
+    // Gaussian mixture model fitted by expectation maximization (ClusterModel)
+    GaussianMixture,
+    // hard-assignment k-means with bound pruning (KMeansModel)
+    KMeans,
+    // three blades 120 degrees apart sharing hub and shape, estimates the rotor angle directly (RotorModel)
+    RotorModel,
+    // peak of the polar histogram of the points around the hub (no EM, hub located once by RotorModel)
+    PolarHistogram,
+    // rotation between consecutive frames from the cross correlation of their angular profiles around the hub
+    // (no clusters, hub located once by RotorModel)
+    AngularCorrelation,
+    // blade clusters from the moments of the connected components of the points in a single pass
+    // (falls back to the Gaussian mixture model if the blades are not separated)
+    ConnectedComponents,
+    // density modes found by mean shift on a spatial hash of the points (MeanShiftModel), no seeding
+    MeanShift
+};
 
 template <class T>
 class ParallelImageProcessor
 {
 public:
     // Constructor
-    ParallelImageProcessor(ImgConverter::ROI roi, std::vector<uint8_t> rgbThreshold, double varianceThreshold, double scale, size_t maxThreads) : 
-        _roi(roi) , _rgbThreshold(rgbThreshold) , _varianceThreshold(varianceThreshold), _scale(scale), _maxThreads(maxThreads) {}
+    ParallelImageProcessor(ImgConverter::ROI roi, std::vector<uint8_t> rgbThreshold, double varianceThreshold, double scale, size_t maxThreads, FitOptions fitOptions = FitOptions(), bool warmStart = false,
+        ClusterEngine engine = ClusterEngine::GaussianMixture, double frameBudget = 0.0, size_t numClusters = 3) : 
+        _roi(roi) , _rgbThreshold(rgbThreshold) , _varianceThreshold(varianceThreshold), _scale(scale), _fitOptions(fitOptions),
+        _warmStart(warmStart), _engine(engine), _frameBudget(frameBudget), _numClusters(numClusters), _pool(maxThreads)
+    {
+        // sub-tasks of the fitting run on the same workers as the frames
+        _fitOptions.threadPool = &_pool;
+    }
+
+    // returns the workers (maxThreads) running the frames and their sub-tasks
+    ThreadPool &getThreadPool() { return _pool; }
 
-    // limit the number of threads running in parallel
-    void readyForNextImage()
+    // returns the pixel coordinates of the rotor blades in a loaded image (scaled for clustering, parameters and
+    // extraction bands of this processor)
+    void extractPoints(ImgConverter &imgConv, std::vector<Vec2> &pointsDbl)
     {
-        std::unique_lock<std::mutex> uLock(_mutex);
-        _cond.wait(uLock, [this] { return _runningThreads < _maxThreads; });
+        // parameters are not changed after construction
+        extractPoints(imgConv, _roi, _rgbThreshold, _varianceThreshold, _scale, pointsDbl, &_fitOptions.getThreadPool(), _fitOptions.numThreads);
     }
 
-    // loads image, extracts points and clusters rotorblades
-    T processImage(T &&msg, std::string filename)
+    // clusters the rotor blade points of a frame whose processing (decoding) started at startTime
+    // (the angular correlation engine samples the decoded image instead of the points)
+    T processPoints(T msg, std::vector<Vec2> pointsDbl, std::chrono::steady_clock::time_point startTime, const ImgConverter *image = nullptr)
     {
         std::unique_lock<std::mutex> lck(_mutex );
-        ++_runningThreads;
         // copy parameters to avoid unnecessary locking/unlocking
         auto roi = _roi;
         auto rgbThreshold = _rgbThreshold;
-        auto scale = _scale;
         auto varianceThreshold = _varianceThreshold;
+        auto scale = _scale;
+        auto fitOptions = _fitOptions;
+        auto engine = _engine;
+        auto frameBudget = _frameBudget;
+        auto numClusters = _numClusters;
+        auto predictedRotation = _predictedRotation;
+        auto polarHistogram = _polarHistogram;
+        auto angularCorrelation = _angularCorrelation;
+        // clusters of the two previous frames (if already fitted) for a warm start
+        ClusterList clustersPrev;
+        ClusterList clustersPrevPrev;
+        if (_warmStart && msg > 0) {
+            auto prev = _results.find(msg - 1);
+            if (prev != _results.end()) {
+                clustersPrev = prev->second.clusters;
+                auto prevPrev = (msg > 1) ? _results.find(msg - 2) : _results.end();
+                if (prevPrev != _results.end())
+                    clustersPrevPrev = prevPrev->second.clusters;
+            }
+        }
         lck.unlock();
 
+        if (frameBudget > 0.0) {
+            // the fitting gets what is left of the frame budget after decoding and extraction
+            auto now = std::chrono::steady_clock::now();
+            auto decodeTime = std::chrono::duration<double>(now - startTime);
+            fitOptions.deadline = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(frameBudget) - decodeTime);
+        }
+
+        if ((engine == ClusterEngine::PolarHistogram && !polarHistogram) || (engine == ClusterEngine::AngularCorrelation && !angularCorrelation)) {
+            // the hub is located once on the first frame, the lookup tables are shared by all frames
+            // (all other frames wait for them, such that the results do not depend on the processing order)
+            if (msg == 0) {
+                Vec2 hub = locateHub(pointsDbl, fitOptions);
+                if (engine == ClusterEngine::PolarHistogram)
+                    polarHistogram = std::make_shared<const PolarHistogram>(roi, hub, scale);
+                else
+                    angularCorrelation = std::make_shared<const AngularCorrelation>(roi, hub, scale, std::vector<ImgConverter::ROI>{towerRegion()});
+                lck.lock();
+                _polarHistogram = polarHistogram;
+                _angularCorrelation = angularCorrelation;
+                _hubCond.notify_all();
+            } else {
+                lck.lock();
+                _hubCond.wait(lck, [this] { return _polarHistogram || _angularCorrelation; });
+                polarHistogram = _polarHistogram;
+                angularCorrelation = _angularCorrelation;
+            }
+            lck.unlock();
+        }
+
+        FrameResult result;
+        if (!clustersPrev.empty()) {
+            // warm start: previous frame's clusters rotated by the predicted rotation per frame
+            // (or else by the rotation between the two previous frames)
+            double rotation = !std::isnan(predictedRotation) ? predictedRotation
+                : (clustersPrevPrev.empty() ? 0.0 : Cluster::getRotation(clustersPrevPrev, clustersPrev));
+            Cluster::rotateClusters(clustersPrev, rotation, result.clusters);
+        } else {
+            initClusters(pointsDbl, result.clusters, numClusters);
+        }
+
+        if (engine == ClusterEngine::AngularCorrelation) {
+            // no clusters, the rotation is measured between the spectra of consecutive frames
+            result.clusters.clear();
+            if (image)
+                angularCorrelation->getSpectrum(*image, rgbThreshold, varianceThreshold, result.angularSpectrum);
+            result.report.converged = true;
+        } else {
+            // fit clusters to extracted points
+            fitClusters(engine, std::move(pointsDbl), result, fitOptions, scale, polarHistogram.get());
+        }
+ 
+        // Add fitted clusters to list (under the lock)
+        lck.lock();
+        _results.insert(std::make_pair(msg, std::move(result)));
+        return msg;
+    }
+
+    // loads an image file and returns the pixel coordinates of the rotor blades (scaled for clustering)
+    static void extractPoints(const std::string &filename, const ImgConverter::ROI roi, const std::vector<uint8_t> &rgbThreshold,
+        const double varianceThreshold, const double scale, std::vector<Vec2> &pointsDbl)
+    {
         // load image file
         ImgConverter imgConv;
         imgConv.load(filename);
+        extractPoints(imgConv, roi, rgbThreshold, varianceThreshold, scale, pointsDbl);
+    }
 
-        // extracting rotor blade points
+    // returns the pixel coordinates of the rotor blades in a loaded image (scaled for clustering). The region
+    // of interest is split into numBands bands of rows which are searched concurrently on the pool
+    static void extractPoints(ImgConverter &imgConv, const ImgConverter::ROI roi, const std::vector<uint8_t> &rgbThreshold,
+        const double varianceThreshold, const double scale, std::vector<Vec2> &pointsDbl, ThreadPool *pool = nullptr, size_t numBands = 1)
+    {
+        // extracting rotor blade points (bands concatenated in row order)
         std::shared_ptr<std::vector<std::vector<size_t>>> points (new std::vector<std::vector<size_t>>());
-        imgConv.getPointsInROIAboveThreshold (roi, rgbThreshold, varianceThreshold, points); // DATA RACE!
+        if (!pool || numBands < 2 || roi.maxRow <= roi.minRow) {
+            imgConv.getPointsInROIAboveThreshold (roi, rgbThreshold, varianceThreshold, points); // DATA RACE!
+        } else {
+            size_t bandRows = (roi.maxRow - roi.minRow + numBands - 1) / numBands;
+            std::vector<std::shared_ptr<ImgConverter::PointList>> bandPoints(numBands);
+            std::vector<std::future<void>> bands;
+            for (size_t iBand = 0; iBand < numBands; ++iBand) {
+                ImgConverter::ROI bandRoi = roi;
+                bandRoi.minRow = std::min(roi.minRow + iBand * bandRows, roi.maxRow);
+                bandRoi.maxRow = std::min(bandRoi.minRow + bandRows, roi.maxRow);
+                bandPoints[iBand] = std::make_shared<ImgConverter::PointList>();
+                auto search = [&imgConv, bandRoi, &rgbThreshold, varianceThreshold, band = bandPoints[iBand]]() {
+                    imgConv.getPointsInROIAboveThreshold (bandRoi, rgbThreshold, varianceThreshold, band);
+                };
+                // first band is searched by the calling thread
+                if (iBand == 0) {
+                    bands.emplace_back();
+                    search();
+                } else {
+                    bands.emplace_back(pool->submit(search));
+                }
+            }
+            for (size_t iBand = 1; iBand < numBands; ++iBand) {
+                pool->wait(bands[iBand]);
+            }
+            for (auto &band : bandPoints) {
+                points->insert(points->end(), band->begin(), band->end());
+            }
+        }
         // remove tower (awful hack - but makes life easier for the first shot!)
         // OPT TODO: add 4th cluster to "catch" tower and ignore "non-moving" clusters
+        const ImgConverter::ROI tower = towerRegion();
         for (auto pnt = points->begin(); pnt !=points->end(); ++pnt) {
             // (*it)[0]: rows | (*it)[1]: cols 
-            if (pnt->back() > 165 && pnt->back() < 205 && pnt->front() > 215) {
+            if (pnt->back() >= tower.minCol && pnt->back() < tower.maxCol && pnt->front() >= tower.minRow && pnt->front() < tower.maxRow) {
                 points->erase(pnt);
                 --pnt;
             }
         }
-            
-        // initialize clusters
+
+        // convert and scale pixel coordinates for clustering
+        pointsDbl.clear();
+        pointsDbl.reserve(points->size());
+        for(int i = 0; i < points->size(); ++i) {
+            pointsDbl.push_back({static_cast<double>((*points)[i][0])/scale,static_cast<double>((*points)[i][1]/scale)});
+        }
+    }
+
+    // region of the tower in pixel coordinates, its pixels are not considered as rotor blade points
+    static ImgConverter::ROI towerRegion()
+    {
+        ImgConverter::ROI tower;
+        tower.minCol = 166;
+        tower.maxCol = 205;
+        tower.minRow = 216;
+        tower.maxRow = std::numeric_limits<size_t>::max();
+        return tower;
+    }
+
+    // initializes numClusters clusters from the extent of the extracted points
+    static void initClusters(const std::vector<Vec2> &pointsDbl, ClusterList &clusters, size_t numClusters = 3)
+    {
         double meanx = 0.0;
         double meany = 0.0;
         double minx  = 1e8;
         double miny  = 1e8;
         double maxx  = 0.0;
         double maxy  = 0.0;
-        // convert and scale pixel coordinates for clustering
-        std::vector<std::vector<double>> pointsDbl;
-        for(int i = 0; i < points->size(); ++i) {
-            pointsDbl.push_back({static_cast<double>((*points)[i][0])/scale,static_cast<double>((*points)[i][1]/scale)});
-            meanx += pointsDbl.back()[0];
-            meany += pointsDbl.back()[1];
-            minx = (pointsDbl.back()[0] < minx) ? pointsDbl.back()[0]: minx;
-            miny = (pointsDbl.back()[1] < miny) ? pointsDbl.back()[1]: miny;
-            maxx = (pointsDbl.back()[0] > maxx) ? pointsDbl.back()[0]: maxx;
-            maxy = (pointsDbl.back()[1] > maxy) ? pointsDbl.back()[1]: maxy;
+        for (auto &pnt : pointsDbl) {
+            meanx += pnt[0];
+            meany += pnt[1];
+            minx = (pnt[0] < minx) ? pnt[0]: minx;
+            miny = (pnt[1] < miny) ? pnt[1]: miny;
+            maxx = (pnt[0] > maxx) ? pnt[0]: maxx;
+            maxy = (pnt[1] > maxy) ? pnt[1]: maxy;
         }
         meanx /= pointsDbl.size();
         meany /= pointsDbl.size();
-        // position 1st cluster in center of extracted points, 2nd and 3rd above / below respectively
+        numClusters = std::min<size_t>(std::max<size_t>(numClusters, 1), maxClusters);
         // initialize covariance matrix as identity matrix 
         // weight corresponds to 1 / (number of clusters)
-//        std::shared_ptr<Cluster> cluster1(new Cluster({meanx,meany}, {{1,0},{0,1}}, 1.0/3.0));
-//        std::shared_ptr<Cluster> cluster2(new Cluster({meanx,meany+maxy/2.0}, {{1,0},{0,1}}, 1.0/3.0));
-//        std::shared_ptr<Cluster> cluster3(new Cluster({meanx,meany-maxy/2.0}, {{1,0},{0,1}}, 1.0/3.0));
-        std::shared_ptr<Cluster> cluster1(new Cluster({minx,meany}, {{1,0},{0,1}}, 1.0/3.0));
-        std::shared_ptr<Cluster> cluster2(new Cluster({meanx,maxy}, {{1,0},{0,1}}, 1.0/3.0));
-        std::shared_ptr<Cluster> cluster3(new Cluster({meanx,miny}, {{1,0},{0,1}}, 1.0/3.0));
-        std::vector<std::shared_ptr<Cluster>> clusters = {cluster1,cluster2,cluster3};
-
-        // fit clusters to extracted points
-        ClusterModel cm(pointsDbl,clusters);
-        cm.runClusterFitting();
- 
-        // Add fitted clusters to list (under the lock)
-        lck.lock();
-        _clusterList.insert(std::make_pair(msg, cm.clusters));
-        --_runningThreads;
-        _cond.notify_one();
-        return msg;
+        double weight = 1.0 / numClusters;
+        clusters.clear();
+        if (numClusters == 3) {
+            // 1st cluster at the left edge of the extracted points, 2nd and 3rd at the top / bottom respectively
+            clusters.emplace_back(Vec2{minx,meany}, Mat2::identity(), weight);
+            clusters.emplace_back(Vec2{meanx,maxy}, Mat2::identity(), weight);
+            clusters.emplace_back(Vec2{meanx,miny}, Mat2::identity(), weight);
+            return;
+        }
+        // evenly spaced on the ellipse through the edges of the extracted points, starting at the left edge
+        const double spacing = 2.0 * std::acos(-1.0) / numClusters;
+        for (size_t i = 0; i < numClusters; ++i) {
+            double angle = spacing * i;
+            clusters.emplace_back(Vec2{meanx - 0.5 * (maxx - minx) * std::cos(angle), meany + 0.5 * (maxy - miny) * std::sin(angle)},
+                Mat2::identity(), weight);
+        }
+    }
+
+    // locates the hub of the rotor by fitting the rotor model to the points
+    static Vec2 locateHub(const std::vector<Vec2> &pointsDbl, const FitOptions &fitOptions)
+    {
+        RotorModel rm(pointsDbl);
+        rm.runClusterFitting(fitOptions);
+        return rm.hub;
+    }
+
+    // fits the clusters (seeded in result.clusters) to the points with the given clustering engine and
+    // stores the points with their labels in the result (the polar histogram engine requires the histogram of the hub)
+    static void fitClusters(const ClusterEngine engine, std::vector<Vec2> pointsDbl, FrameResult &result, const FitOptions &fitOptions,
+        const double scale, const PolarHistogram *polarHistogram = nullptr)
+    {
+        if (engine == ClusterEngine::ConnectedComponents) {
+            ConnectedComponents cc(std::move(pointsDbl), scale);
+            if (cc.run()) {
+                cc.getClusters(result.clusters);
+                result.report.converged = true;
+                result.points = std::move(cc.points);
+                result.labels = std::move(cc.labels);
+                return;
+            }
+            // blades merged, fall back to the mixture model
+            pointsDbl = std::move(cc.points);
+        }
+        if (engine == ClusterEngine::PolarHistogram && polarHistogram) {
+            result.report = polarHistogram->estimate(pointsDbl, result);
+            result.points = std::move(pointsDbl);
+        } else if (engine == ClusterEngine::MeanShift) {
+            MeanShiftModel ms(std::move(pointsDbl));
+            result.report = ms.runClusterFitting();
+            ms.getClusters(result.clusters);
+            result.points = std::move(ms.points);
+            result.labels = std::move(ms.labels);
+        } else if (engine == ClusterEngine::KMeans) {
+            KMeansModel km(std::move(pointsDbl), result.clusters);
+            result.report = km.runClusterFitting(fitOptions);
+            result.clusters = km.clusters;
+            result.points = std::move(km.points);
+            result.labels = std::move(km.labels);
+        } else if (engine == ClusterEngine::RotorModel) {
+            RotorModel rm(std::move(pointsDbl));
+            result.report = rm.runClusterFitting(fitOptions);
+            result.rotorAngle = rm.getRotorAngle();
+            rm.getClusters(result.clusters);
+            result.points = std::move(rm.points);
+            result.labels = std::move(rm.labels);
+        } else if (fitOptions.restarts > 1) {
+            result.report = fitClusterModelSpeculative(pointsDbl, result.clusters, result.labels, fitOptions);
+            result.points = std::move(pointsDbl);
+        } else {
+            // specialized kernels for two, three and four blades
+            result.report = fitClusterModel(pointsDbl, result.clusters, result.labels, fitOptions);
+            result.points = std::move(pointsDbl);
+        }
+    }
+
+    // sets the predicted rotation per frame in rad used to seed the warm start (e.g. by a rotor state tracker, NaN: none)
+    void setRotationPrediction(double rotation)
+    {
+        std::unique_lock<std::mutex> uLock(_mutex);
+        _predictedRotation = rotation;
+    }
+
+    // releases the results of all frames before the given frame (no longer needed by the consumer, the warm
+    // start of the frames still to be fitted only looks back two frames from the latest consumed frame)
+    void releaseFramesBefore(const size_t frameID)
+    {
+        std::unique_lock<std::mutex> uLock(_mutex);
+        _results.erase(_results.begin(), _results.lower_bound(frameID));
     }
 
     // returns the clusters identified in the given frame
-    void getClusters(const  size_t frameID, std::vector<std::shared_ptr<Cluster>> &clusters)
+    void getClusters(const  size_t frameID, ClusterList &clusters)
+    {
+        std::unique_lock<std::mutex> uLock(_mutex);
+        clusters = _results.find(frameID)->second.clusters;
+    }
+
+    // returns the points of the given frame and the index of the cluster each point belongs to
+    void getPoints(const size_t frameID, std::vector<Vec2> &points, std::vector<uint8_t> &labels)
+    {
+        std::unique_lock<std::mutex> uLock(_mutex);
+        const FrameResult &result = _results.find(frameID)->second;
+        points = result.points;
+        labels = result.labels;
+    }
+
+    // returns the telemetry of the cluster fitting of the given frame
+    FitReport getFitReport(const size_t frameID)
+    {
+        std::unique_lock<std::mutex> uLock(_mutex);
+        return _results.find(frameID)->second.report;
+    }
+
+    // returns the rotor angle of the given frame (NaN if the engine does not estimate it directly)
+    double getRotorAngle(const size_t frameID)
+    {
+        std::unique_lock<std::mutex> uLock(_mutex);
+        return _results.find(frameID)->second.rotorAngle;
+    }
+
+    // returns the rotation between two frames measured by angular correlation (NaN if the engine does not measure it)
+    double getRotation(const size_t frameIDPrev, const size_t frameIDCur)
     {
         std::unique_lock<std::mutex> uLock(_mutex);
-        clusters = _clusterList.find(frameID)->second;
+        if (!_angularCorrelation)
+            return NAN;
+        return _angularCorrelation->getRotation(_results.find(frameIDPrev)->second.angularSpectrum, _results.find(frameIDCur)->second.angularSpectrum);
     }
 
 
 private:
     std::mutex _mutex;
-    std::condition_variable _cond;
+    // notified when the hub has been located on the first frame
+    std::condition_variable _hubCond;
     std::deque<T> _messages;
 
     ImgConverter::ROI _roi;
     std::vector<uint8_t> _rgbThreshold{200,200,200};
     double _scale{1};
-    size_t _maxThreads{4};
-    size_t _runningThreads{0};
+    // convergence policy and threads of the cluster fitting within a single frame
+    FitOptions _fitOptions;
+    // seed the clusters with the (rotated) clusters of the previous frame if it has already been fitted
+    bool _warmStart{false};
+    // clustering algorithm
+    ClusterEngine _engine{ClusterEngine::GaussianMixture};
+    // processing time per frame in seconds including decoding, the cluster fitting stops when it is used up (0: no deadline)
+    double _frameBudget{0.0};
+    // number of clusters seeded for the fitting (rotor blades)
+    size_t _numClusters{3};
+    // predicted rotation per frame for the warm start (NaN: rotation between the two previous frames)
+    double _predictedRotation{NAN};
+    // angle lookup table of the polar histogram engine (built from the first frame)
+    std::shared_ptr<const PolarHistogram> _polarHistogram;
+    // polar sampling and FFT plan of the angular correlation engine (built from the first frame)
+    std::shared_ptr<const AngularCorrelation> _angularCorrelation;
     double _varianceThreshold;
-    // maps frame ID to list of clusters detected in this frame
-    std::map<size_t,std::vector<std::shared_ptr<Cluster>>> _clusterList;
+    // maps frame ID to the clusters detected in this frame and the telemetry of their fitting
+    // (frames in flight and the latest consumed frames, see releaseFramesBefore)
+    std::map<size_t,FrameResult> _results;
+    // workers running the frames and their sub-tasks (declared last: joined before the members above are destroyed)
+    ThreadPool _pool;
 };
 
 #endif // PARALLELIMAGEPROCESSOR_H_
@@ -0,0 +1,155 @@
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "thread_pool.h"
+
+// Chain of processing stages run as tasks on a thread pool, thus the stages share the workers of the pool with
+// the sub-tasks of the items (no threads of their own). Each stage buffers the items it received and runs them
+// on at most maxConcurrency workers at once (stateful stages on a single worker), a worker takes the next item
+// of the stage when it starts, so the items leave the buffer in the order of the source (ordered stages wait
+// for the next item in source order, unordered stages take the earliest item they hold). The source is throttled
+// to a maximum number of items in flight, which bounds the buffers, thus the memory of a run does not grow with
+// the number of items. The buffers are guarded by a mutex per stage (no lock-free queues): they reorder the items
+// for ordered stages and count the workers of the stage, and are touched only a few times per item.
+template <class T>
+class Pipeline
+{
+public:
+    using Stage = std::function<void(T &)>;
+
+    // Constructor (pool running the stages and maximum number of items in flight, 0: unlimited)
+    Pipeline(ThreadPool &pool, std::size_t maxInFlight = 0) : _pool(pool), _maxInFlight(maxInFlight) {}
+    Pipeline(const Pipeline &src) = delete;
+    Pipeline &operator=(const Pipeline &src) = delete;
+
+    // appends a stage run by at most maxConcurrency workers at once
+    void addStage(Stage stage, std::size_t maxConcurrency = 1, bool ordered = false)
+    {
+        _stages.emplace_back(new StageState());
+        _stages.back()->stage = std::move(stage);
+        _stages.back()->maxConcurrency = std::max<std::size_t>(maxConcurrency, 1);
+        _stages.back()->ordered = ordered;
+    }
+
+    // pushes the items produced by the source (returns false when there are no more items) through all stages,
+    // returns when the last item has left the last stage. The source is called by the calling thread
+    void run(const std::function<bool(T &)> &source)
+    {
+        if (_stages.empty())
+            return;
+        std::size_t sequence = 0;
+        for (;; ++sequence) {
+            // wait until an item has left the pipeline if the maximum is in flight
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _finishedCond.wait(lock, [this, sequence] { return _maxInFlight == 0 || sequence < _finished + _maxInFlight; });
+            }
+            Item item;
+            item.sequence = sequence;
+            if (!source(item.value))
+                break;
+            receive(0, std::move(item));
+        }
+        // the tasks still touch the stages after passing on their last item
+        std::unique_lock<std::mutex> lock(_mutex);
+        _finishedCond.wait(lock, [this, sequence] { return _finished == sequence && _tasks == 0; });
+    }
+
+private:
+    // item with its position in the order of the source
+    struct Item
+    {
+        std::size_t sequence{0};
+        T value{};
+    };
+    struct StageState
+    {
+        Stage stage;
+        std::size_t maxConcurrency{1};
+        bool ordered{false};
+        // guards the members below
+        std::mutex mutex;
+        // items received and not yet taken, by sequence
+        std::map<std::size_t, Item> pending;
+        // sequence of the next item of an ordered stage
+        std::size_t next{0};
+        // tasks scheduled for this stage
+        std::size_t active{0};
+
+        // returns true if an item can be taken (the next item in source order for ordered stages)
+        bool hasNext() const { return !pending.empty() && (!ordered || pending.begin()->first == next); }
+    };
+
+    // buffers an item at the stage and schedules a task for it unless the stage is running at its limit
+    void receive(std::size_t iStage, Item item)
+    {
+        StageState &state = *_stages[iStage];
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            std::size_t sequence = item.sequence;
+            state.pending.emplace(sequence, std::move(item));
+            if (state.active == state.maxConcurrency || !state.hasNext())
+                return;
+            ++state.active;
+        }
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            ++_tasks;
+        }
+        // a stage task is no sub-task of the item passed on, it must not run inside a wait for sub-tasks
+        _pool.submitExternal([this, iStage]() {
+            runStage(iStage);
+            std::lock_guard<std::mutex> lock(_mutex);
+            --_tasks;
+            _finishedCond.notify_all();
+        });
+    }
+
+    // runs the items of a stage as long as there are items to take, passes them on to the next stage
+    void runStage(std::size_t iStage)
+    {
+        StageState &state = *_stages[iStage];
+        while (true) {
+            Item item;
+            {
+                std::lock_guard<std::mutex> lock(state.mutex);
+                if (!state.hasNext()) {
+                    --state.active;
+                    return;
+                }
+                item = std::move(state.pending.begin()->second);
+                state.pending.erase(state.pending.begin());
+                state.next = item.sequence + 1;
+            }
+            state.stage(item.value);
+            if (iStage + 1 < _stages.size()) {
+                receive(iStage + 1, std::move(item));
+            } else {
+                std::lock_guard<std::mutex> lock(_mutex);
+                ++_finished;
+                _finishedCond.notify_all();
+            }
+        }
+    }
+
+    ThreadPool &_pool;
+    std::size_t _maxInFlight;
+    std::vector<std::unique_ptr<StageState>> _stages;
+    // guards the counters below, notified when an item has left the pipeline or a task has ended
+    std::mutex _mutex;
+    std::condition_variable _finishedCond;
+    // number of items which have left the last stage
+    std::size_t _finished{0};
+    // number of scheduled stage tasks
+    std::size_t _tasks{0};
+};
+
+#endif // PIPELINE_H_
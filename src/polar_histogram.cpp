@@ -0,0 +1,123 @@
+#ifndef POLAR_HISTOGRAM_CPP_
+#define POLAR_HISTOGRAM_CPP_
+# define PI           3.14159265358979323846
+#include <algorithm>
+#include <math.h>
+
+#include "polar_histogram.h"
+
+PolarHistogram::PolarHistogram(const ImgConverter::ROI &roi, const Vec2 &hub, double scale, size_t numBins) :
+    _roi(roi), _hub(hub), _scale(scale)
+{
+    _numBins = std::max<size_t>((numBins + numBlades - 1) / numBlades, 1) * numBlades;
+    size_t nRows = roi.maxRow - roi.minRow;
+    size_t nCols = roi.maxCol - roi.minCol;
+    _binLUT.resize(nRows * nCols);
+    double binsPerRad = _numBins / (2.0 * PI);
+    for (size_t row = 0; row < nRows; ++row) {
+        for (size_t col = 0; col < nCols; ++col) {
+            double phi = std::atan2((roi.minCol + col) / scale - hub[1], (roi.minRow + row) / scale - hub[0]);
+            phi = (phi < 0) ? phi + 2.0 * PI : phi;
+            _binLUT[row * nCols + col] = static_cast<uint16_t>(std::min<size_t>(static_cast<size_t>(phi * binsPerRad), _numBins - 1));
+        }
+    }
+}
+
+size_t PolarHistogram::getBin(const Vec2 &pnt) const
+{
+    long row = std::lround(pnt[0] * _scale);
+    long col = std::lround(pnt[1] * _scale);
+    if (row >= static_cast<long>(_roi.minRow) && row < static_cast<long>(_roi.maxRow) &&
+        col >= static_cast<long>(_roi.minCol) && col < static_cast<long>(_roi.maxCol)) {
+        return _binLUT[(row - _roi.minRow) * (_roi.maxCol - _roi.minCol) + (col - _roi.minCol)];
+    }
+    // points outside the region of interest (not expected)
+    double phi = std::atan2(pnt[1] - _hub[1], pnt[0] - _hub[0]);
+    phi = (phi < 0) ? phi + 2.0 * PI : phi;
+    return std::min<size_t>(static_cast<size_t>(phi * _numBins / (2.0 * PI)), _numBins - 1);
+}
+
+FitReport PolarHistogram::estimate(const std::vector<Vec2> &points, FrameResult &result) const
+{
+    FitReport report;
+    const size_t foldedBins = _numBins / numBlades;
+    const double binWidth = 2.0 * PI / _numBins;
+    const double bladeSpacing = 2.0 * PI / numBlades;
+
+    // histogram of the point angles
+    std::vector<size_t> pointBins(points.size());
+    std::vector<double> histogram(_numBins, 0.0);
+    for (size_t iPnt = 0; iPnt < points.size(); ++iPnt) {
+        pointBins[iPnt] = getBin(points[iPnt]);
+        histogram[pointBins[iPnt]] += 1.0;
+    }
+
+    // fold onto a single blade period and smooth
+    std::vector<double> folded(foldedBins, 0.0);
+    for (size_t bin = 0; bin < _numBins; ++bin) {
+        folded[bin % foldedBins] += histogram[bin];
+    }
+    std::vector<double> smoothed(foldedBins);
+    for (size_t bin = 0; bin < foldedBins; ++bin) {
+        smoothed[bin] = folded[(bin + foldedBins - 1) % foldedBins] + 2.0 * folded[bin] + folded[(bin + 1) % foldedBins];
+    }
+
+    // locate the peak with sub-bin accuracy: centroid of the folded histogram above its minimum
+    // within a twelfth of the blade period around the peak bin
+    size_t peak = std::max_element(smoothed.begin(), smoothed.end()) - smoothed.begin();
+    double background = *std::min_element(folded.begin(), folded.end());
+    long halfWidth = std::max<long>(foldedBins / 12, 1);
+    double sumWeight = 0.0;
+    double sumOffset = 0.0;
+    for (long offset = -halfWidth; offset <= halfWidth; ++offset) {
+        double count = folded[(peak + foldedBins + offset) % foldedBins] - background;
+        sumWeight += count;
+        sumOffset += count * offset;
+    }
+    double delta = (sumWeight > 0.0) ? sumOffset / sumWeight : 0.0;
+    double angle = (peak + 0.5 + delta) * binWidth;
+    result.rotorAngle = angle;
+
+    // assign each angle bin to the blade sector it lies in
+    std::vector<size_t> binLabels(_numBins);
+    for (size_t bin = 0; bin < _numBins; ++bin) {
+        long sector = std::lround(((bin + 0.5) * binWidth - angle) / bladeSpacing);
+        binLabels[bin] = ((sector % static_cast<long>(numBlades)) + numBlades) % numBlades;
+    }
+
+    // blade clusters from the moments of their points (relative to the hub)
+    double weight[numBlades] = {};
+    Vec2 first[numBlades] = {};
+    Mat2 second[numBlades] = {};
+    for (size_t iPnt = 0; iPnt < points.size(); ++iPnt) {
+        size_t k = binLabels[pointBins[iPnt]];
+        Vec2 dist = points[iPnt] - _hub;
+        weight[k] += 1.0;
+        first[k] += dist;
+        second[k] += Mat2::outer(dist, dist);
+    }
+    result.clusters.clear();
+    result.labels.resize(points.size());
+    for (size_t k = 0; k < numBlades; ++k) {
+        // empty blades are elongated along the center of their sector
+        double bladeAngle = angle + bladeSpacing * k;
+        Mat2 rot{{{std::cos(bladeAngle), -std::sin(bladeAngle)}, {std::sin(bladeAngle), std::cos(bladeAngle)}}};
+        Vec2 center = _hub;
+        Mat2 sigma = rot * Mat2{{{1.0, 0.0}, {0.0, 0.1}}} * rot.transpose();
+        if (weight[k] > 0.0) {
+            Vec2 mean = first[k] * (1.0 / weight[k]);
+            center = _hub + mean;
+            sigma = second[k] * (1.0 / weight[k]) - Mat2::outer(mean, mean);
+        } else {
+            report.emptyCluster = true;
+        }
+        result.clusters.emplace_back(center, sigma, weight[k] / std::max<size_t>(points.size(), 1));
+    }
+    for (size_t iPnt = 0; iPnt < points.size(); ++iPnt) {
+        result.labels[iPnt] = static_cast<uint8_t>(binLabels[pointBins[iPnt]]);
+    }
+    report.converged = true;
+    return report;
+}
+
+#endif /* POLAR_HISTOGRAM_CPP_ */
@@ -0,0 +1,46 @@
+#ifndef POLAR_HISTOGRAM_H_
+#define POLAR_HISTOGRAM_H_
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+#include "clustering.h"
+#include "frame_result.h"
+#include "img_converter.h"
+
+// Clustering-free estimation of the rotor angle for a known hub position: the rotor blade points are binned
+// by their polar angle around the hub, the histogram is folded onto a single blade period (2 pi / numBlades)
+// so that the peaks of the three blades add up, and the rotor angle is located at the peak of the folded
+// histogram. The angle bin of every pixel in the region of interest is precomputed in a lookup table, thus
+// the estimation costs a table lookup per point.
+class PolarHistogram
+{
+public:
+    // number of blades of the rotor
+    static constexpr std::size_t numBlades = 3;
+
+    // Constructor: precomputes the angle bin of each pixel in the region of interest around the hub
+    // (hub in scaled coordinates as the points, numBins is rounded up to a multiple of numBlades)
+    PolarHistogram(const ImgConverter::ROI &roi, const Vec2 &hub, double scale, std::size_t numBins = 360);
+
+    // estimates the rotor angle of the points (scaled pixel coordinates) and assigns each point to the blade
+    // sector it lies in. The blades are returned as clusters with mean and covariance of their points,
+    // the blade sector of each point in result.labels
+    FitReport estimate(const std::vector<Vec2> &points, FrameResult &result) const;
+    // returns the hub position
+    const Vec2 &getHub() const { return _hub; }
+
+private:
+    ImgConverter::ROI _roi;
+    Vec2 _hub;
+    double _scale;
+    std::size_t _numBins;
+    // angle bin of each pixel in the region of interest (row major), bin 0 starts at angle 0
+    std::vector<uint16_t> _binLUT;
+
+    // returns the angle bin of a point (scaled pixel coordinates)
+    std::size_t getBin(const Vec2 &pnt) const;
+};
+
+#endif // POLAR_HISTOGRAM_H_
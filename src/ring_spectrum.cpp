@@ -0,0 +1,131 @@
+#ifndef RING_SPECTRUM_CPP_
+#define RING_SPECTRUM_CPP_
+# define PI           3.14159265358979323846
+#include <algorithm>
+#include <math.h>
+
+#include "ring_spectrum.h"
+
+// steps per bin of the refinement of the dominant frequency
+static const std::size_t refinementSteps = 16;
+
+RingSpectrum::RingSpectrum(const Vec2 &hub, const std::vector<double> &radii, size_t samplesPerRing, size_t windowSize) :
+    _windowSize(std::max<size_t>(windowSize, 2))
+{
+    for (double radius : radii) {
+        for (size_t i = 0; i < samplesPerRing; ++i) {
+            double phi = 2.0 * PI * i / samplesPerRing;
+            long row = std::lround(hub[0] + radius * std::cos(phi));
+            long col = std::lround(hub[1] + radius * std::sin(phi));
+            if (row >= 0 && col >= 0) {
+                _samples.push_back({static_cast<size_t>(row), static_cast<size_t>(col)});
+            }
+        }
+    }
+    _history.assign(_samples.size() * _windowSize, 0.0);
+    _bins.assign(_samples.size() * numBins(), 0.0);
+    for (size_t k = 1; k <= numBins(); ++k) {
+        _shifts.push_back(std::polar(1.0, 2.0 * PI * k / _windowSize));
+    }
+}
+
+void RingSpectrum::addFrame(ImgConverter &img)
+{
+    size_t slot = _frameCount % _windowSize;
+    std::vector<uint8_t> rgbVal = {0,0,0};
+    for (size_t iSample = 0; iSample < _samples.size(); ++iSample) {
+        double intensity = 0.0;
+        if (img.inBound(_samples[iSample])) {
+            img.getRGBValue(_samples[iSample], rgbVal);
+            intensity = rgbVal[0] + rgbVal[1] + rgbVal[2];
+        }
+        // sliding DFT: drop the oldest frame, add the new frame and shift the window by one frame
+        double &value = _history[iSample * _windowSize + slot];
+        double change = intensity - value;
+        value = intensity;
+        std::complex<double> *bins = &_bins[iSample * numBins()];
+        for (size_t k = 0; k < numBins(); ++k) {
+            bins[k] = (bins[k] + change) * _shifts[k];
+        }
+    }
+    ++_frameCount;
+    if (_frameCount % _windowSize == 0) {
+        recomputeBins();
+    }
+}
+
+void RingSpectrum::recomputeBins()
+{
+    for (size_t iSample = 0; iSample < _samples.size(); ++iSample) {
+        std::complex<double> *bins = &_bins[iSample * numBins()];
+        for (size_t k = 0; k < numBins(); ++k) {
+            bins[k] = 0.0;
+            for (size_t n = 0; n < _windowSize; ++n) {
+                double value = _history[iSample * _windowSize + (_frameCount + n) % _windowSize];
+                bins[k] += std::polar(value, -2.0 * PI * (k + 1) * n / _windowSize);
+            }
+        }
+    }
+}
+
+double RingSpectrum::getPower(double frequency) const
+{
+    double coeff = 2.0 * std::cos(2.0 * PI * frequency / _windowSize);
+    double power = 0.0;
+    for (size_t iSample = 0; iSample < _samples.size(); ++iSample) {
+        const double *history = &_history[iSample * _windowSize];
+        double mean = 0.0;
+        for (size_t n = 0; n < _windowSize; ++n) {
+            mean += history[n];
+        }
+        mean /= _windowSize;
+        // Goertzel recursion over the window from the oldest to the latest frame
+        double s1 = 0.0;
+        double s2 = 0.0;
+        for (size_t n = 0; n < _windowSize; ++n) {
+            double s0 = history[(_frameCount + n) % _windowSize] - mean + coeff * s1 - s2;
+            s2 = s1;
+            s1 = s0;
+        }
+        power += s1 * s1 + s2 * s2 - coeff * s1 * s2;
+    }
+    return power;
+}
+
+double RingSpectrum::getDominantFrequency() const
+{
+    // peak bin of the power summed over all pixels
+    size_t peak = 0;
+    double peakPower = -1.0;
+    for (size_t k = 0; k < numBins(); ++k) {
+        double power = 0.0;
+        for (size_t iSample = 0; iSample < _samples.size(); ++iSample) {
+            power += std::norm(_bins[iSample * numBins() + k]);
+        }
+        if (power > peakPower) {
+            peakPower = power;
+            peak = k;
+        }
+    }
+
+    // refine between the neighbouring bins
+    double bestFrequency = peak + 1.0;
+    double bestPower = -1.0;
+    double minFrequency = std::max(static_cast<double>(peak), 0.5);
+    double maxFrequency = std::min(peak + 2.0, static_cast<double>(numBins()));
+    for (double frequency = minFrequency; frequency <= maxFrequency; frequency += 1.0 / refinementSteps) {
+        double power = getPower(frequency);
+        if (power > bestPower) {
+            bestPower = power;
+            bestFrequency = frequency;
+        }
+    }
+    return bestFrequency / _windowSize;
+}
+
+double RingSpectrum::getAngularVelocity() const
+{
+    return 2.0 * PI * getDominantFrequency() / numBlades;
+}
+
+#endif /* RING_SPECTRUM_CPP_ */
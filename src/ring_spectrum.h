@@ -0,0 +1,56 @@
+#ifndef RING_SPECTRUM_H_
+#define RING_SPECTRUM_H_
+
+#include <complex>
+#include <vector>
+
+#include "img_converter.h"
+#include "small_matrix.h"
+
+// Streaming estimation of the rotor speed without segmentation: the intensity of a few rings of pixels
+// around the hub is sampled in each frame. The blades sweeping a pixel make its intensity periodic with the
+// blade passing frequency (numBlades times the rotor frequency). A sliding DFT of the intensity of each pixel
+// over the latest frames is updated per frame (one complex multiply-add per pixel and frequency bin), the
+// dominant frequency is the peak of the power summed over all pixels, refined between the bins by Goertzel
+// evaluations on the stored window.
+class RingSpectrum
+{
+public:
+    // number of blades of the rotor
+    static constexpr std::size_t numBlades = 3;
+
+    // Constructor: samples samplesPerRing pixels on each ring with the given radii (pixels) around the hub (pixel coordinates)
+    RingSpectrum(const Vec2 &hub, const std::vector<double> &radii, std::size_t samplesPerRing, std::size_t windowSize);
+
+    // samples the pixel intensities of the next frame and updates the spectrum of the window
+    void addFrame(ImgConverter &img);
+    // returns true if the window is filled with frames
+    bool isFull() const { return _frameCount >= _windowSize; }
+    // returns the number of frames added
+    std::size_t size() const { return _frameCount; }
+    // returns the dominant blade passing frequency of the window in cycles per frame
+    double getDominantFrequency() const;
+    // returns the angular velocity of the rotor in rad per frame corresponding to the dominant frequency
+    double getAngularVelocity() const;
+
+private:
+    // sampled pixels
+    std::vector<ImgConverter::Point> _samples;
+    std::size_t _windowSize;
+    std::size_t _frameCount{0};
+    // intensities of each pixel in the window (ring buffer per pixel, the oldest frame at _frameCount % _windowSize)
+    std::vector<double> _history;
+    // DFT bins 1 ... windowSize / 2 of the intensities of each pixel
+    std::vector<std::complex<double>> _bins;
+    // exp(2 pi i k / windowSize) shifting bin k by one frame
+    std::vector<std::complex<double>> _shifts;
+
+    // number of frequency bins per pixel
+    std::size_t numBins() const { return _windowSize / 2; }
+    // recomputes the bins of all pixels from the window (removes the round-off accumulated by the sliding updates)
+    void recomputeBins();
+    // power at the given frequency (bins, need not be an integer) summed over all pixels (Goertzel algorithm)
+    double getPower(double frequency) const;
+};
+
+#endif // RING_SPECTRUM_H_
@@ -0,0 +1,187 @@
+#ifndef ROTOR_MODEL_CPP_
+#define ROTOR_MODEL_CPP_
+# define PI           3.14159265358979323846
+#include <algorithm>
+#include <math.h>
+
+#include "rotor_model.h"
+
+RotorModel::RotorModel(std::vector<Vec2> pointsIn) : points(std::move(pointsIn))
+{
+    // hub in the centroid of the points
+    hub = Vec2::zero();
+    for (auto &pnt : points) {
+        hub += pnt;
+    }
+    hub = hub * (1.0 / std::max<size_t>(points.size(), 1));
+
+    // blade directions repeat every 2 pi / numBlades, thus the circular moment of order numBlades
+    // of the points around the hub points along the blades
+    double re = 0.0;
+    double im = 0.0;
+    double meanRadius = 0.0;
+    for (auto &pnt : points) {
+        Vec2 dist = pnt - hub;
+        double radius = dist.norm();
+        double phi = std::atan2(dist[1], dist[0]);
+        re += radius * std::cos(numBlades * phi);
+        im += radius * std::sin(numBlades * phi);
+        meanRadius += radius;
+    }
+    meanRadius /= std::max<size_t>(points.size(), 1);
+    double angle = std::atan2(im, re) / numBlades;
+
+    // blade center in the mean distance from the hub, blade shape elongated along the blade
+    // (variance of a uniform segment of twice the mean radius along, a tenth of that across the blade)
+    Vec2 dir{std::cos(angle), std::sin(angle)};
+    bladeOffset = dir * meanRadius;
+    Mat2 rot{{{dir[0], -dir[1]}, {dir[1], dir[0]}}};
+    Mat2 shape{{{meanRadius * meanRadius / 3.0, 0.0}, {0.0, meanRadius * meanRadius / 30.0}}};
+    bladeSigma = rot * shape * rot.transpose();
+}
+
+Mat2 RotorModel::bladeRotation(size_t k)
+{
+    double angle = 2.0 * PI * k / numBlades;
+    return Mat2{{{std::cos(angle), -std::sin(angle)}, {std::sin(angle), std::cos(angle)}}};
+}
+
+FitReport RotorModel::runClusterFitting(const FitOptions &options)
+{
+    FitReport report;
+    double lastLikelihood(0);
+    const double logWeight = log(1.0 / numBlades);
+    labels.assign(points.size(), 0);
+
+    Mat2 rot[numBlades];
+    for (size_t k = 0; k < numBlades; ++k) {
+        rot[k] = bladeRotation(k);
+    }
+
+    // deadline passed after the latest maximization step
+    bool outOfTime = false;
+    for (size_t i = 0; i < options.maxIterations; i++)
+    {
+        // =======================================================
+        // EXPECTATION STEP
+        // =======================================================
+        // blade clusters of the current rotor parameters
+        Vec2 centers[numBlades];
+        Mat2 sigmaChol[numBlades];
+        double logConst[numBlades];
+        bool success = true;
+        for (size_t k = 0; k < numBlades; ++k) {
+            centers[k] = hub + rot[k] * bladeOffset;
+            success = (rot[k] * bladeSigma * rot[k].transpose()).cholesky(sigmaChol[k]) && success;
+            logConst[k] = -log(2 * PI) - log(sigmaChol[k][0][0]) - log(sigmaChol[k][1][1]) + logWeight;
+        }
+        if (!success) {
+            report.choleskyFailed = true;
+            break;
+        }
+
+        // weighted moments of the points wrt. each blade, relative to the hub
+        double weight[numBlades] = {};
+        Vec2 first[numBlades] = {};
+        Mat2 second[numBlades] = {};
+        double likelihood = 0.0;
+        for (size_t iPnt = 0; iPnt < points.size(); ++iPnt) {
+            const Vec2 &pnt = points[iPnt];
+            double logProb[numBlades];
+            double maxProb = -1e8;
+            for (size_t k = 0; k < numBlades; ++k) {
+                logProb[k] = logConst[k] - sigmaChol[k].solveLower(pnt - centers[k]).squaredNorm() / 2.0;
+                maxProb = std::max(maxProb, logProb[k]);
+            }
+            double expsum = 0.0;
+            for (size_t k = 0; k < numBlades; ++k) {
+                expsum += exp(logProb[k] - maxProb);
+            }
+            double logsum = maxProb + log(expsum);
+            likelihood += logsum;
+
+            Vec2 dist = pnt - hub;
+            double curMax = 0.0;
+            for (size_t k = 0; k < numBlades; ++k) {
+                double prob = exp(logProb[k] - logsum);
+                weight[k] += prob;
+                first[k] += dist * prob;
+                second[k] += Mat2::outer(dist, dist * prob);
+                if (curMax < prob) {
+                    curMax = prob;
+                    labels[iPnt] = k;
+                }
+            }
+        }
+        report.iterations = i + 1;
+        report.logLikelihood = likelihood;
+        // out of time? => return the rotor so far with its log likelihood and labels
+        if (outOfTime) {
+            report.partial = true;
+            break;
+        }
+
+        // Rotor not changing anymore? => done.
+        if (std::fabs(likelihood - lastLikelihood) < options.likelihoodTolerance * std::fabs(likelihood)) {
+            report.converged = true;
+            break;
+        }
+        lastLikelihood = likelihood;
+
+        // =======================================================
+        // MAXIMIZATION STEP
+        // =======================================================
+        // blade offset and shape: mean and covariance of the points folded onto the first blade
+        double weightSum = 0.0;
+        Vec2 offset = Vec2::zero();
+        Mat2 shape = Mat2::zero();
+        for (size_t k = 0; k < numBlades; ++k) {
+            report.emptyCluster = report.emptyCluster || weight[k] < 1e-9;
+            weightSum += weight[k];
+            offset += rot[k].transpose() * first[k];
+            shape += rot[k].transpose() * second[k] * rot[k];
+        }
+        offset = offset * (1.0 / weightSum);
+        shape = shape * (1.0 / weightSum) - Mat2::outer(offset, offset);
+        bladeOffset = offset;
+        bladeSigma = shape;
+
+        // hub: weighted least squares of the blade centers for the new blade shape
+        Mat2 shapeInv;
+        if (!shape.inverse(shapeInv)) {
+            report.choleskyFailed = true;
+            break;
+        }
+        Mat2 normal = Mat2::zero();
+        Vec2 rhs = Vec2::zero();
+        for (size_t k = 0; k < numBlades; ++k) {
+            Mat2 precision = rot[k] * shapeInv * rot[k].transpose();
+            normal += precision * weight[k];
+            rhs += precision * (first[k] - rot[k] * offset * weight[k]);
+        }
+        Mat2 normalInv;
+        if (normal.inverse(normalInv)) {
+            hub = hub + normalInv * rhs;
+        }
+
+        // the rotor so far is evaluated by one more expectation step before returning it
+        outOfTime = i + 1 < options.maxIterations && options.deadlinePassed();
+    }
+    return report;
+}
+
+double RotorModel::getRotorAngle() const
+{
+    return std::atan2(bladeOffset[1], bladeOffset[0]);
+}
+
+void RotorModel::getClusters(ClusterList &clusters) const
+{
+    clusters.clear();
+    for (size_t k = 0; k < numBlades; ++k) {
+        Mat2 rot = bladeRotation(k);
+        clusters.emplace_back(hub + rot * bladeOffset, rot * bladeSigma * rot.transpose(), 1.0 / numBlades);
+    }
+}
+
+#endif /* ROTOR_MODEL_CPP_ */
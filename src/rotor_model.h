@@ -0,0 +1,47 @@
+#ifndef ROTOR_MODEL_H_
+#define ROTOR_MODEL_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include "clustering.h"
+
+// Rotation-constrained mixture model of a rotor with three blades 120 degrees apart. Instead of three
+// independent clusters, the rotor is described by a single hub position, the offset of the first blade's
+// center from the hub (its direction is the rotor angle) and one covariance matrix of the blade shape which
+// is shared by all blades (rotated by the blade's angle). The parameters are fitted by expectation conditional
+// maximization: the blade offset and shape are updated on the points folded onto the first blade, afterwards
+// the hub is updated for the new blade shape. Both updates are closed form.
+class RotorModel
+{
+public:
+    // number of blades of the rotor
+    static constexpr std::size_t numBlades = 3;
+
+    // position of the rotor hub
+    Vec2 hub;
+    // offset of the first blade's center from the hub
+    Vec2 bladeOffset;
+    // covariance matrix of the first blade
+    Mat2 bladeSigma;
+    // vector of points which are to be clustered
+    std::vector<Vec2> points;
+    // blade index each point is most likely generated by (after fitting)
+    std::vector<uint8_t> labels;
+
+    // Constructor: initializes the rotor from the centroid and the third circular moment of the points
+    RotorModel(std::vector<Vec2> points);
+
+    // finds best fit of the rotor parameters for the points by expectation conditional maximization
+    FitReport runClusterFitting(const FitOptions &options = FitOptions());
+    // returns the rotor angle in rad (direction of the first blade, defined modulo 2 pi / numBlades)
+    double getRotorAngle() const;
+    // returns the blades as clusters (labels are the blade indices)
+    void getClusters(ClusterList &clusters) const;
+
+private:
+    // rotation of blade k wrt. the first blade
+    static Mat2 bladeRotation(std::size_t k);
+};
+
+#endif // ROTOR_MODEL_H_
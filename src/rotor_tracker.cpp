@@ -0,0 +1,86 @@
+#ifndef ROTOR_TRACKER_CPP_
+#define ROTOR_TRACKER_CPP_
+#include <algorithm>
+#include <math.h>
+
+#include "rotor_tracker.h"
+
+// number of frames in a row which may be skipped before the state is reacquired from the next frame
+static const std::size_t maxSkipped = 3;
+// number of corrections before outliers are skipped (the angular velocity is not known yet)
+static const std::size_t minCorrections = 3;
+// initial standard deviation of the angular velocity in rad per frame
+static const double initialVelocityStd = 0.5;
+
+// wraps an angle into [-period/2, period/2)
+static double wrapAngle(double angle, double period)
+{
+    return angle - period * std::floor(angle / period + 0.5);
+}
+
+RotorTracker::RotorTracker(double accelerationNoise, double angleNoise, double gate) :
+    _accelerationNoise(accelerationNoise), _angleNoise(angleNoise), _gate(gate) {}
+
+double RotorTracker::getAngularVelocityStd() const
+{
+    return std::sqrt(_covariance[1][1]);
+}
+
+bool RotorTracker::update(const std::vector<double> &bladeAngles, const std::vector<bool> &continued, double period)
+{
+    if (!_initialized) {
+        // the rotor angle of the first frame is the reference, the angular velocity is unknown
+        _state = Vec2{{0.0, 0.0}};
+        _covariance = Mat2{{{_angleNoise * _angleNoise, 0.0}, {0.0, initialVelocityStd * initialVelocityStd}}};
+        _initialized = true;
+    } else {
+        // prediction: constant angular velocity, white noise angular acceleration
+        Mat2 transition{{{1.0, 1.0}, {0.0, 1.0}}};
+        double q = _accelerationNoise * _accelerationNoise;
+        Mat2 processNoise{{{q / 4.0, q / 2.0}, {q / 2.0, q}}};
+        _state = transition * _state;
+        _covariance = transition * _covariance * transition.transpose() + processNoise;
+    }
+    _offsets.resize(std::max(_offsets.size(), bladeAngles.size()), NAN);
+
+    // mean innovation of the blades with known offset, new blades fix their offset to the predicted angle
+    double innovation = 0.0;
+    std::size_t numMeasured = 0;
+    for (std::size_t k = 0; k < _offsets.size(); ++k) {
+        double angle = (k < bladeAngles.size()) ? bladeAngles[k] : NAN;
+        if (std::isnan(angle)) {
+            _offsets[k] = NAN;
+        } else if (std::isnan(_offsets[k]) || k >= continued.size() || !continued[k]) {
+            _offsets[k] = wrapAngle(angle - _state[0], period);
+        } else {
+            innovation += wrapAngle(angle - _state[0] - _offsets[k], period);
+            ++numMeasured;
+        }
+    }
+    if (numMeasured == 0)
+        return true;
+    innovation /= numMeasured;
+
+    // skip outliers, if too many frames in a row are outliers the angular velocity is reacquired
+    double innovationVariance = _covariance[0][0] + _angleNoise * _angleNoise / numMeasured;
+    if (_corrections >= minCorrections && innovation * innovation > _gate * _gate * innovationVariance) {
+        if (_skipped < maxSkipped) {
+            ++_skipped;
+            return false;
+        }
+        _covariance = Mat2{{{_covariance[0][0] + innovation * innovation, 0.0}, {0.0, initialVelocityStd * initialVelocityStd}}};
+        innovationVariance = _covariance[0][0] + _angleNoise * _angleNoise / numMeasured;
+        _corrections = 0;
+    }
+    _skipped = 0;
+    ++_corrections;
+
+    // correction
+    Vec2 gain{{_covariance[0][0] / innovationVariance, _covariance[1][0] / innovationVariance}};
+    _state += gain * innovation;
+    Mat2 update{{{1.0 - gain[0], 0.0}, {-gain[1], 1.0}}};
+    _covariance = update * _covariance;
+    return true;
+}
+
+#endif /* ROTOR_TRACKER_CPP_ */
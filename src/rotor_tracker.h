@@ -0,0 +1,49 @@
+#ifndef ROTOR_TRACKER_H_
+#define ROTOR_TRACKER_H_
+
+#include <vector>
+
+#include "small_matrix.h"
+
+// Streaming Kalman filter of the rotor state (rotor angle and angular velocity per frame, constant velocity
+// model with random angular acceleration). Each frame is a single prediction and correction step on a 2x2
+// covariance, thus the cost per frame is constant. The rotor angle is measured by the angles of the blades,
+// which are only defined modulo a period (e.g. pi/2 for the cluster axes): each blade has a fixed offset to
+// the rotor angle and the innovations are wrapped into the period. Frames whose innovation is far outside
+// the expected spread are skipped (failed fits). If too many frames in a row are skipped, the angular velocity
+// is reacquired.
+class RotorTracker
+{
+public:
+    // Constructor (standard deviations of the angular acceleration in rad per frame^2 and of a blade angle in rad)
+    RotorTracker(double accelerationNoise = 1e-4, double angleNoise = 2e-3, double gate = 4.0);
+
+    // advances to the next frame and corrects the state by the blade angles of this frame (by blade index, NaN:
+    // blade not measured) defined modulo period. Blades which were not continued from the previous frame
+    // (new or re-identified) only fix their offset to the rotor angle. Returns false if the frame was skipped
+    bool update(const std::vector<double> &bladeAngles, const std::vector<bool> &continued, double period);
+    // returns the filtered rotor angle of the latest frame in rad (relative to the first frame)
+    double getAngle() const { return _state[0]; }
+    // returns the filtered angular velocity in rad per frame and its standard deviation
+    double getAngularVelocity() const { return _state[1]; }
+    double getAngularVelocityStd() const;
+    // returns the predicted rotor angle of the next frame, the predicted rotation from the latest to the next
+    // frame is the angular velocity
+    double getPredictedAngle() const { return _state[0] + _state[1]; }
+
+private:
+    double _accelerationNoise;
+    double _angleNoise;
+    double _gate;
+    // rotor angle and angular velocity and their covariance
+    Vec2 _state{};
+    Mat2 _covariance{};
+    bool _initialized{false};
+    // frames skipped in a row and corrections since the (re)acquisition
+    std::size_t _skipped{0};
+    std::size_t _corrections{0};
+    // offset of each blade angle to the rotor angle (NaN: not set)
+    std::vector<double> _offsets;
+};
+
+#endif // ROTOR_TRACKER_H_
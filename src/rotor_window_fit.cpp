@@ -0,0 +1,214 @@
+#ifndef ROTOR_WINDOW_FIT_CPP_
+#define ROTOR_WINDOW_FIT_CPP_
+# define PI           3.14159265358979323846
+#include <algorithm>
+#include <math.h>
+
+#include "rotor_window_fit.h"
+#include "rotor_model.h"
+
+// number of maximization steps on the cached moments per added frame
+static const std::size_t maximizationSteps = 3;
+
+Mat2 RotorWindowFit::bladeRotation(size_t t, size_t k) const
+{
+    // rotor angle of frame t extrapolated from the latest frame
+    double dt = static_cast<double>(t) - static_cast<double>(_frameCount - 1);
+    double angle = _angle + _omega * dt + 2.0 * PI * k / numBlades;
+    return Mat2{{{std::cos(angle), -std::sin(angle)}, {std::sin(angle), std::cos(angle)}}};
+}
+
+void RotorWindowFit::initialize(const std::vector<Vec2> &points)
+{
+    RotorModel rm(points);
+    rm.runClusterFitting(_options);
+    // express blade offset and shape in the rotor frame
+    _angle = rm.getRotorAngle();
+    Mat2 rot{{{std::cos(_angle), -std::sin(_angle)}, {std::sin(_angle), std::cos(_angle)}}};
+    _hub = rm.hub;
+    _bladeOffset = rot.transpose() * rm.bladeOffset;
+    _bladeSigma = rot.transpose() * rm.bladeSigma * rot;
+    _omega = 0.0;
+}
+
+bool RotorWindowFit::expectation(FrameStatistics &frame) const
+{
+    const double logWeight = log(1.0 / numBlades);
+    // blade clusters of the current rotor parameters in this frame
+    Vec2 centers[numBlades];
+    Mat2 sigmaChol[numBlades];
+    double logConst[numBlades];
+    for (size_t k = 0; k < numBlades; ++k) {
+        Mat2 rot = bladeRotation(frame.t, k);
+        centers[k] = _hub + rot * _bladeOffset;
+        if (!(rot * _bladeSigma * rot.transpose()).cholesky(sigmaChol[k]))
+            return false;
+        logConst[k] = -log(2 * PI) - log(sigmaChol[k][0][0]) - log(sigmaChol[k][1][1]) + logWeight;
+    }
+    // the cached moments are only overwritten once all blade covariances are valid
+    for (size_t k = 0; k < numBlades; ++k) {
+        frame.weight[k] = 0.0;
+        frame.first[k] = Vec2::zero();
+        frame.second[k] = Mat2::zero();
+    }
+
+    frame.likelihood = 0.0;
+    for (auto &pnt : frame.points) {
+        double logProb[numBlades];
+        double maxProb = -1e8;
+        for (size_t k = 0; k < numBlades; ++k) {
+            logProb[k] = logConst[k] - sigmaChol[k].solveLower(pnt - centers[k]).squaredNorm() / 2.0;
+            maxProb = std::max(maxProb, logProb[k]);
+        }
+        double expsum = 0.0;
+        for (size_t k = 0; k < numBlades; ++k) {
+            expsum += exp(logProb[k] - maxProb);
+        }
+        double logsum = maxProb + log(expsum);
+        frame.likelihood += logsum;
+        for (size_t k = 0; k < numBlades; ++k) {
+            double prob = exp(logProb[k] - logsum);
+            frame.weight[k] += prob;
+            frame.first[k] += pnt * prob;
+            frame.second[k] += Mat2::outer(pnt, pnt * prob);
+        }
+    }
+    return true;
+}
+
+bool RotorWindowFit::maximize()
+{
+    // blade offset and shape: mean and covariance of all points transformed into the rotor frame
+    double weightSum = 0.0;
+    Vec2 offset = Vec2::zero();
+    Mat2 shape = Mat2::zero();
+    for (auto &frame : _frames) {
+        for (size_t k = 0; k < numBlades; ++k) {
+            Mat2 rot = bladeRotation(frame.t, k);
+            // moments relative to the hub
+            Vec2 first = frame.first[k] - _hub * frame.weight[k];
+            Mat2 second = frame.second[k] - Mat2::outer(frame.first[k], _hub) - Mat2::outer(_hub, frame.first[k])
+                + Mat2::outer(_hub, _hub) * frame.weight[k];
+            weightSum += frame.weight[k];
+            offset += rot.transpose() * first;
+            shape += rot.transpose() * second * rot;
+        }
+    }
+    if (weightSum < 1e-9)
+        return false;
+    offset = offset * (1.0 / weightSum);
+    shape = shape * (1.0 / weightSum) - Mat2::outer(offset, offset);
+    // keep the first blade along the first axis of the rotor frame by moving its direction into the rotor angle
+    double psi = std::atan2(offset[1], offset[0]);
+    Mat2 rotPsi{{{std::cos(psi), -std::sin(psi)}, {std::sin(psi), std::cos(psi)}}};
+    _bladeOffset = rotPsi.transpose() * offset;
+    _bladeSigma = rotPsi.transpose() * shape * rotPsi;
+    _angle += psi;
+
+    // rotor angle and angular velocity: weighted linear regression of the angle residuals of all frames,
+    // measured by the direction of each frame's points folded onto the first blade
+    double sw = 0.0, swt = 0.0, swtt = 0.0, swe = 0.0, swte = 0.0;
+    const double bladeSpacing = 2.0 * PI / numBlades;
+    for (auto &frame : _frames) {
+        Vec2 folded = Vec2::zero();
+        double weight = 0.0;
+        for (size_t k = 0; k < numBlades; ++k) {
+            double bladeAngle = bladeSpacing * k;
+            Mat2 rot{{{std::cos(bladeAngle), -std::sin(bladeAngle)}, {std::sin(bladeAngle), std::cos(bladeAngle)}}};
+            folded += rot.transpose() * (frame.first[k] - _hub * frame.weight[k]);
+            weight += frame.weight[k];
+        }
+        double dt = static_cast<double>(frame.t) - static_cast<double>(_frameCount - 1);
+        double residual = std::atan2(folded[1], folded[0]) - (_angle + _omega * dt);
+        residual -= bladeSpacing * std::round(residual / bladeSpacing);
+        sw += weight;
+        swt += weight * dt;
+        swtt += weight * dt * dt;
+        swe += weight * residual;
+        swte += weight * dt * residual;
+    }
+    double det = sw * swtt - swt * swt;
+    if (_frames.size() > 1 && det > 1e-9 * sw * sw) {
+        _angle += (swtt * swe - swt * swte) / det;
+        _omega += (sw * swte - swt * swe) / det;
+    } else {
+        _angle += swe / sw;
+    }
+
+    // hub: weighted least squares of the blade centers of all frames for the new parameters
+    Mat2 shapeInv;
+    if (!_bladeSigma.inverse(shapeInv))
+        return false;
+    Mat2 normal = Mat2::zero();
+    Vec2 rhs = Vec2::zero();
+    for (auto &frame : _frames) {
+        for (size_t k = 0; k < numBlades; ++k) {
+            Mat2 rot = bladeRotation(frame.t, k);
+            Mat2 precision = rot * shapeInv * rot.transpose();
+            normal += precision * frame.weight[k];
+            rhs += precision * (frame.first[k] - (_hub + rot * _bladeOffset) * frame.weight[k]);
+        }
+    }
+    Mat2 normalInv;
+    if (normal.inverse(normalInv)) {
+        _hub = _hub + normalInv * rhs;
+    }
+    return true;
+}
+
+FitReport RotorWindowFit::addFrame(std::vector<Vec2> points)
+{
+    FitReport report;
+    FrameStatistics frame;
+    frame.points = std::move(points);
+    frame.t = _frameCount;
+    // rotor parameters before the frame, restored if the frame cannot be added
+    Vec2 hub = _hub;
+    Vec2 bladeOffset = _bladeOffset;
+    Mat2 bladeSigma = _bladeSigma;
+    double angle = _angle;
+    double omega = _omega;
+    if (_frames.empty()) {
+        initialize(frame.points);
+    } else {
+        // predict rotor angle of the new frame
+        _angle += _omega;
+    }
+    ++_frameCount;
+
+    // expectation step of the new frame, the frame is only committed to the window if it succeeds
+    if (!expectation(frame)) {
+        --_frameCount;
+        _hub = hub;
+        _bladeOffset = bladeOffset;
+        _bladeSigma = bladeSigma;
+        _angle = angle;
+        _omega = omega;
+        report.choleskyFailed = true;
+        return report;
+    }
+    report.iterations = 1;
+    _frames.push_back(std::move(frame));
+    while (_frames.size() > std::max<size_t>(_windowSize, 1)) {
+        _frames.pop_front();
+    }
+
+    // refresh the expectation step of one older frame
+    if (_frames.size() > 1) {
+        report.choleskyFailed = !expectation(_frames[_refreshIndex % (_frames.size() - 1)]);
+        ++_refreshIndex;
+        ++report.iterations;
+    }
+
+    // maximization steps on the cached moments of the window
+    for (size_t i = 0; i < maximizationSteps && !report.choleskyFailed; ++i) {
+        report.choleskyFailed = !maximize();
+    }
+    for (auto &cachedFrame : _frames) {
+        report.logLikelihood += cachedFrame.likelihood;
+    }
+    report.converged = !report.choleskyFailed;
+    return report;
+}
+
+#endif /* ROTOR_WINDOW_FIT_CPP_ */
@@ -0,0 +1,76 @@
+#ifndef ROTOR_WINDOW_FIT_H_
+#define ROTOR_WINDOW_FIT_H_
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "clustering.h"
+
+// Joint fit of the rotor model (see RotorModel) to the points of a sliding window of consecutive frames.
+// Hub and blade shape are shared by all frames of the window, the rotor angle of frame t follows
+// angle + omega * (t - t_latest), such that the angular velocity omega is a parameter of the fit
+// instead of a difference of noisy per-frame angles.
+// The fit is incremental: the weighted moments of each frame's points wrt. each blade are cached in
+// absolute coordinates, so the maximization step runs on the cached moments of all frames only.
+// When a frame is added, the expectation step is run on the new frame and on one older frame of the
+// window (round robin), thus the cost per frame is about two expectation steps regardless of the window size.
+class RotorWindowFit
+{
+public:
+    // number of blades of the rotor
+    static constexpr std::size_t numBlades = 3;
+
+    // Constructor
+    RotorWindowFit(std::size_t windowSize, const FitOptions &options = FitOptions()) : _windowSize(windowSize), _options(options) {};
+
+    // adds the points of the next frame, drops the oldest frame if the window is full and refits the window
+    // (a frame whose expectation step fails is dropped and leaves the fit unchanged)
+    FitReport addFrame(std::vector<Vec2> points);
+    // returns the angular velocity in rad per frame (0 until two frames have been added)
+    double getAngularVelocity() const { return _omega; }
+    // returns the rotor angle of the latest frame in rad (defined modulo 2 pi / numBlades)
+    double getRotorAngle() const { return _angle; }
+    // returns the number of frames currently in the window
+    std::size_t size() const { return _frames.size(); }
+
+private:
+    // points of a frame and their weighted moments wrt. each blade (in absolute coordinates)
+    struct FrameStatistics {
+        std::vector<Vec2> points;
+        // frame index
+        std::size_t t;
+        double weight[numBlades];
+        Vec2 first[numBlades];
+        Mat2 second[numBlades];
+        double likelihood;
+    };
+
+    std::size_t _windowSize;
+    FitOptions _options;
+    std::deque<FrameStatistics> _frames;
+    // index of the next frame
+    std::size_t _frameCount{0};
+    // index of the next frame whose expectation step is refreshed
+    std::size_t _refreshIndex{0};
+
+    // rotor parameters: hub, blade offset and covariance in the rotor frame (first blade along the first axis),
+    // rotor angle of the latest frame and angular velocity (rad per frame)
+    Vec2 _hub{};
+    Vec2 _bladeOffset{};
+    Mat2 _bladeSigma{};
+    double _angle{0.0};
+    double _omega{0.0};
+
+    // rotation from the rotor frame to blade k of frame t
+    Mat2 bladeRotation(std::size_t t, std::size_t k) const;
+    // initializes the rotor parameters from a single frame
+    void initialize(const std::vector<Vec2> &points);
+    // expectation step of a single frame: caches its weighted moments. Returns false (leaving the cached moments
+    // unchanged) if a blade covariance is not positive definite
+    bool expectation(FrameStatistics &frame) const;
+    // maximization step on the cached moments of all frames in the window
+    bool maximize();
+};
+
+#endif // ROTOR_WINDOW_FIT_H_
@@ -0,0 +1,282 @@
+#ifndef SMALL_MATRIX_H_
+#define SMALL_MATRIX_H_
+
+#include <cstddef>
+#include <cmath>
+
+// Fixed-size vector and square matrix types for the per-cluster math. Both are plain aggregates
+// (no heap allocation) so that centers, covariances and their decompositions stay in registers.
+// The dimension is a template parameter; the 2x2 case used for image points has closed-form
+// implementations of the Cholesky decomposition, the inverse and the eigen-decomposition.
+
+// column vector of dimension N
+template <std::size_t N>
+struct Vec
+{
+    double data[N];
+
+    constexpr double &operator[](std::size_t i) { return data[i]; }
+    constexpr const double &operator[](std::size_t i) const { return data[i]; }
+
+    // returns the zero vector
+    static constexpr Vec zero()
+    {
+        Vec res{};
+        return res;
+    }
+
+    constexpr Vec operator+(const Vec &other) const
+    {
+        Vec res{};
+        for (std::size_t i = 0; i < N; ++i)
+            res[i] = data[i] + other[i];
+        return res;
+    }
+
+    constexpr Vec operator-(const Vec &other) const
+    {
+        Vec res{};
+        for (std::size_t i = 0; i < N; ++i)
+            res[i] = data[i] - other[i];
+        return res;
+    }
+
+    constexpr Vec operator*(double scalar) const
+    {
+        Vec res{};
+        for (std::size_t i = 0; i < N; ++i)
+            res[i] = data[i] * scalar;
+        return res;
+    }
+
+    constexpr Vec &operator+=(const Vec &other)
+    {
+        for (std::size_t i = 0; i < N; ++i)
+            data[i] += other[i];
+        return *this;
+    }
+
+    // inner product with another vector
+    constexpr double dot(const Vec &other) const
+    {
+        double res = 0.0;
+        for (std::size_t i = 0; i < N; ++i)
+            res += data[i] * other[i];
+        return res;
+    }
+
+    constexpr double squaredNorm() const { return dot(*this); }
+
+    double norm() const { return std::sqrt(squaredNorm()); }
+};
+
+// square matrix of dimension N x N (row major)
+template <std::size_t N>
+struct Mat
+{
+    double data[N][N];
+
+    constexpr double *operator[](std::size_t row) { return data[row]; }
+    constexpr const double *operator[](std::size_t row) const { return data[row]; }
+
+    // returns the zero matrix
+    static constexpr Mat zero()
+    {
+        Mat res{};
+        return res;
+    }
+
+    // returns the identity matrix
+    static constexpr Mat identity()
+    {
+        Mat res{};
+        for (std::size_t i = 0; i < N; ++i)
+            res[i][i] = 1.0;
+        return res;
+    }
+
+    // returns the outer product a * b^T
+    static constexpr Mat outer(const Vec<N> &a, const Vec<N> &b)
+    {
+        Mat res{};
+        for (std::size_t i = 0; i < N; ++i)
+            for (std::size_t j = 0; j < N; ++j)
+                res[i][j] = a[i] * b[j];
+        return res;
+    }
+
+    constexpr Mat operator+(const Mat &other) const
+    {
+        Mat res{};
+        for (std::size_t i = 0; i < N; ++i)
+            for (std::size_t j = 0; j < N; ++j)
+                res[i][j] = data[i][j] + other[i][j];
+        return res;
+    }
+
+    constexpr Mat operator-(const Mat &other) const
+    {
+        Mat res{};
+        for (std::size_t i = 0; i < N; ++i)
+            for (std::size_t j = 0; j < N; ++j)
+                res[i][j] = data[i][j] - other[i][j];
+        return res;
+    }
+
+    constexpr Mat operator*(double scalar) const
+    {
+        Mat res{};
+        for (std::size_t i = 0; i < N; ++i)
+            for (std::size_t j = 0; j < N; ++j)
+                res[i][j] = data[i][j] * scalar;
+        return res;
+    }
+
+    constexpr Mat &operator+=(const Mat &other)
+    {
+        for (std::size_t i = 0; i < N; ++i)
+            for (std::size_t j = 0; j < N; ++j)
+                data[i][j] += other[i][j];
+        return *this;
+    }
+
+    constexpr Vec<N> operator*(const Vec<N> &vec) const
+    {
+        Vec<N> res{};
+        for (std::size_t i = 0; i < N; ++i)
+            for (std::size_t j = 0; j < N; ++j)
+                res[i] += data[i][j] * vec[j];
+        return res;
+    }
+
+    constexpr Mat operator*(const Mat &other) const
+    {
+        Mat res{};
+        for (std::size_t i = 0; i < N; ++i)
+            for (std::size_t j = 0; j < N; ++j)
+                for (std::size_t k = 0; k < N; ++k)
+                    res[i][j] += data[i][k] * other[k][j];
+        return res;
+    }
+
+    constexpr Mat transpose() const
+    {
+        Mat res{};
+        for (std::size_t i = 0; i < N; ++i)
+            for (std::size_t j = 0; j < N; ++j)
+                res[i][j] = data[j][i];
+        return res;
+    }
+
+    constexpr double trace() const
+    {
+        double res = 0.0;
+        for (std::size_t i = 0; i < N; ++i)
+            res += data[i][i];
+        return res;
+    }
+
+    constexpr double determinant() const
+    {
+        static_assert(N == 2, "determinant is only implemented in closed form for 2x2 matrices");
+        return data[0][0] * data[1][1] - data[0][1] * data[1][0];
+    }
+
+    // Cholesky decomposition of a positive definite matrix into a lower triangular matrix.
+    // Returns false (leaving the entries computed so far) if the matrix is not positive definite or not finite.
+    // Pseudo code of the generic variant can be found here: http://www.mosismath.com/Cholesky/Cholesky.html
+    bool cholesky(Mat &lower) const
+    {
+        lower = zero();
+        // NaN entries would pass the sign checks below
+        for (std::size_t i = 0; i < N; i++)
+            for (std::size_t j = 0; j < N; j++)
+                if (!std::isfinite(data[i][j]))
+                    return false;
+        if constexpr (N == 2) {
+            // Avoid negative roots
+            if (data[0][0] < 0)
+                return false;
+            lower[0][0] = std::sqrt(data[0][0]);
+            // Avoid division by zero
+            if (lower[0][0] < 1.e-8)
+                return false;
+            lower[1][0] = data[1][0] / lower[0][0];
+            double l11 = data[1][1] - lower[1][0] * lower[1][0];
+            lower[1][1] = l11;
+            if (l11 < 0)
+                return false;
+            lower[1][1] = std::sqrt(l11);
+            return true;
+        } else {
+            for (std::size_t i = 0; i < N; i++) {
+                for (std::size_t j = 0; j < i; j++) {
+                    lower[i][j] = data[i][j];
+                    for (std::size_t k = 0; k < j; k++)
+                        lower[i][j] -= lower[i][k] * lower[j][k];
+                    if (lower[j][j] < 1.e-8)
+                        return false;
+                    lower[i][j] /= lower[j][j];
+                }
+                lower[i][i] = data[i][i];
+                for (std::size_t k = 0; k < i; k++)
+                    lower[i][i] -= lower[i][k] * lower[i][k];
+                if (lower[i][i] < 0)
+                    return false;
+                lower[i][i] = std::sqrt(lower[i][i]);
+            }
+            return true;
+        }
+    }
+
+    // solves this * x = b for x, assuming this matrix is in lower triangular form
+    constexpr Vec<N> solveLower(const Vec<N> &b) const
+    {
+        Vec<N> x{};
+        for (std::size_t i = 0; i < N; i++) {
+            double s = 0.0;
+            for (std::size_t j = 0; j < i; j++)
+                s += data[i][j] * x[j];
+            x[i] = (b[i] - s) / data[i][i];
+        }
+        return x;
+    }
+
+    // inverse of the matrix. Returns false if the matrix is (numerically) singular
+    bool inverse(Mat &inv) const
+    {
+        static_assert(N == 2, "inverse is only implemented in closed form for 2x2 matrices");
+        double det = determinant();
+        if (std::fabs(det) < 1.e-12)
+            return false;
+        inv[0][0] = data[1][1] / det;
+        inv[0][1] = -data[0][1] / det;
+        inv[1][0] = -data[1][0] / det;
+        inv[1][1] = data[0][0] / det;
+        return true;
+    }
+
+    // eigen-decomposition of a symmetric matrix. Eigenvalues are sorted in descending order,
+    // the columns of vectors hold the corresponding normalized eigenvectors
+    void symmetricEigen(Vec<N> &values, Mat &vectors) const
+    {
+        static_assert(N == 2, "eigen-decomposition is only implemented in closed form for 2x2 matrices");
+        double a = data[0][0];
+        double b = data[1][1];
+        double c = data[0][1];
+        double d = std::sqrt((a - b) * (a - b) + 4.0 * c * c);
+        values[0] = 0.5 * (a + b + d);
+        values[1] = 0.5 * (a + b - d);
+        // orientation of the major principal axis wrt. the first axis
+        double phi = 0.5 * std::atan2(2.0 * c, a - b);
+        vectors[0][0] = std::cos(phi);
+        vectors[1][0] = std::sin(phi);
+        vectors[0][1] = -vectors[1][0];
+        vectors[1][1] = vectors[0][0];
+    }
+};
+
+using Vec2 = Vec<2>;
+using Mat2 = Mat<2>;
+
+#endif /* SMALL_MATRIX_H_ */
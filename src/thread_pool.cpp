@@ -0,0 +1,120 @@
+#ifndef THREAD_POOL_CPP_
+#define THREAD_POOL_CPP_
+#include <algorithm>
+
+#include "thread_pool.h"
+
+thread_local ThreadPool *ThreadPool::_currentPool = nullptr;
+thread_local std::size_t ThreadPool::_currentIndex = 0;
+
+ThreadPool::ThreadPool(std::size_t numThreads)
+{
+    numThreads = std::max<std::size_t>(numThreads, 1);
+    for (std::size_t i = 0; i < numThreads; ++i) {
+        _queues.emplace_back(new WorkerQueue());
+    }
+    for (std::size_t i = 0; i < numThreads; ++i) {
+        _threads.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _cond.notify_all();
+    for (auto &thread : _threads) {
+        thread.join();
+    }
+}
+
+ThreadPool &ThreadPool::getDefault()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::push(Task task, bool external)
+{
+    // count the task first, such that the counter never falls below the number of queued tasks
+    external = external || !isWorker();
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        ++_pending;
+        if (external)
+            _external.push_back(std::move(task));
+    }
+    if (!external) {
+        WorkerQueue &queue = *_queues[_currentIndex];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    _cond.notify_one();
+}
+
+bool ThreadPool::pop(Task &task, bool external)
+{
+    std::size_t numQueues = _queues.size();
+    // own deque, most recent task first
+    {
+        WorkerQueue &queue = *_queues[_currentIndex];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            --_pending;
+            return true;
+        }
+    }
+    // steal the oldest task of another worker
+    for (std::size_t offset = 1; offset < numQueues; ++offset) {
+        WorkerQueue &queue = *_queues[(_currentIndex + offset) % numQueues];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            --_pending;
+            return true;
+        }
+    }
+    if (external) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_external.empty()) {
+            task = std::move(_external.front());
+            _external.pop_front();
+            --_pending;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::runPendingTask()
+{
+    Task task;
+    if (!pop(task, false))
+        return false;
+    task();
+    return true;
+}
+
+void ThreadPool::workerLoop(std::size_t index)
+{
+    _currentPool = this;
+    _currentIndex = index;
+    while (true) {
+        Task task;
+        if (pop(task, true)) {
+            task();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cond.wait(lock, [this] { return _stop || _pending > 0; });
+        if (_stop && _pending == 0)
+            return;
+    }
+}
+
+#endif /* THREAD_POOL_CPP_ */
@@ -0,0 +1,108 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running the frame tasks and their sub-tasks (point extraction bands, chunks of
+// the expectation step, speculative restarts, image encoding). Every worker has its own task deque: tasks
+// submitted by a worker are pushed to and popped from the back of its own deque (most recent first), idle
+// workers steal from the front of the other workers' deques. Tasks submitted from outside the pool and
+// independent tasks submitted by submitExternal (the stages of the pipeline) are queued in submission order and
+// only started by idle workers, after all pending sub-tasks.
+class ThreadPool
+{
+public:
+    // Constructor (starts the workers, at least one)
+    ThreadPool(std::size_t numThreads = std::thread::hardware_concurrency());
+    // Destructor (finishes all queued tasks and joins the workers)
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &src) = delete;
+    ThreadPool &operator=(const ThreadPool &src) = delete;
+
+    // queues the task and returns the future of its result
+    template <class F>
+    auto submit(F &&task) -> std::future<decltype(task())>
+    {
+        using R = decltype(task());
+        auto packaged = std::make_shared<std::packaged_task<R()>>(std::forward<F>(task));
+        std::future<R> future = packaged->get_future();
+        push([packaged]() { (*packaged)(); }, false);
+        return future;
+    }
+
+    // queues a task which is no sub-task of the calling task like a task submitted from outside the pool, thus
+    // a worker waiting for its sub-tasks never runs it inside wait
+    template <class F>
+    auto submitExternal(F &&task) -> std::future<decltype(task())>
+    {
+        using R = decltype(task());
+        auto packaged = std::make_shared<std::packaged_task<R()>>(std::forward<F>(task));
+        std::future<R> future = packaged->get_future();
+        push([packaged]() { (*packaged)(); }, true);
+        return future;
+    }
+
+    // waits for the future and returns its result. A worker of this pool runs pending sub-tasks while waiting
+    // (but never starts an external task), so tasks waiting for their sub-tasks cannot exhaust the workers
+    template <class R>
+    R wait(std::future<R> &future)
+    {
+        while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            if (!isWorker() || !runPendingTask())
+                future.wait_for(std::chrono::microseconds(100));
+        }
+        return future.get();
+    }
+
+    // returns the number of workers
+    std::size_t size() const { return _threads.size(); }
+    // returns true if the calling thread is a worker of this pool
+    bool isWorker() const { return _currentPool == this; }
+
+    // pool shared by all users without a pool of their own (one worker per core)
+    static ThreadPool &getDefault();
+
+private:
+    using Task = std::function<void()>;
+    // task deque of a worker (back: owner, front: thieves)
+    struct WorkerQueue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    // queues a task on the deque of the calling worker or else (or if external is set) on the queue of external tasks
+    void push(Task task, bool external);
+    // takes a task from the own deque, from another worker's deque or (only if external is set) from the
+    // queue of external tasks
+    bool pop(Task &task, bool external);
+    // runs a pending sub-task of the calling worker, returns false if there is none
+    bool runPendingTask();
+    void workerLoop(std::size_t index);
+
+    std::vector<std::unique_ptr<WorkerQueue>> _queues;
+    std::vector<std::thread> _threads;
+    // tasks submitted from outside the pool
+    std::deque<Task> _external;
+    // guards the external queue and the sleep of idle workers
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    // number of queued tasks (all deques)
+    std::atomic<std::size_t> _pending{0};
+    bool _stop{false};
+
+    // pool and deque index of the calling worker thread
+    static thread_local ThreadPool *_currentPool;
+    static thread_local std::size_t _currentIndex;
+};
+
+#endif // THREAD_POOL_H_